@@ -16,9 +16,12 @@
 # include "config.h"
 #endif
 
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include <X11/Xlib.h>
 #include <X11/Xresource.h>
+#include <X11/Xutil.h>
 
 
 #if DEBUG
@@ -38,6 +41,35 @@ enum aInputState {
 };
 
 
+/* decoded image, pixels are stored in the native-endian ARGB32 format */
+struct aImage {
+    unsigned int width;
+    unsigned int height;
+    uint32_t *pixels;
+};
+
+
+/* queue of pending (possibly asynchronous) strip captures */
+struct aCaptureQueue {
+    unsigned int head;
+    unsigned int count;
+    struct {
+        Drawable drawable;
+        int x, y;
+        unsigned int height;
+        /* sequence number of the XCB request or 0 */
+        unsigned int sequence;
+    } requests[4];
+};
+
+
+/* image scaling filters */
+enum aImageFilter {
+    AIMAGE_FILTER_BILINEAR,
+    AIMAGE_FILTER_LANCZOS3,
+};
+
+
 /* module base interface */
 struct aModule {
     const char *name;
@@ -50,11 +82,20 @@ struct aModule {
 struct aModuleAuth {
     struct aModule m;
     int (*authenticate)(const char *pass);
+    /* Optional password verification, which is free of side effects (e.g.
+     * failed attempts are not recorded), hence it can be used speculatively.
+     * Negative result is not authoritative. It is called from the worker
+     * thread, possibly concurrently with the authenticate() (but never with
+     * itself), so it must not share any scratch state with it. Might be NULL. */
+    int (*verify)(const char *pass);
 };
 
 struct aModuleBackground {
     struct aModule m;
     Window (*getwindow)(int screen);
+    /* Adjust the window of the given screen to the new screen geometry. If
+     * NULL, the window is resized by the core. */
+    void (*resize)(int screen, int width, int height);
 };
 
 struct aModuleCursor {
@@ -67,6 +108,29 @@ struct aModuleInput {
     Window (*getwindow)(int screen);
     KeySym (*keypress)(KeySym key);
     void (*setstate)(enum aInputState state);
+    /* Repaint given region of the exposed window. If NULL, the module does
+     * not need to be notified about exposures. */
+    void (*expose)(Window window, Region region);
+    /* Adjust the window of the given screen to the new screen geometry.
+     * Might be NULL. */
+    void (*resize)(int screen, int width, int height);
+    /* Reflect the input buffer state (number of entered characters and the
+     * cursor position). It is called at most once per display frame, after
+     * all pending events have been processed. Might be NULL. */
+    void (*update)(unsigned int length, unsigned int position);
+};
+
+
+struct aModuleOverlay {
+    struct aModule m;
+    /* Attach overlay to the background window of the given screen. */
+    void (*attach)(int screen, Window window);
+    /* Redraw content which has changed since the last call. This function
+     * returns the time (in milliseconds) after which it shall be called
+     * again, or -1 if the content does not change over time. */
+    long (*refresh)(void);
+    /* Repaint given region of the exposed window. */
+    void (*expose)(Window window, Region region);
 };
 
 
@@ -76,6 +140,7 @@ struct aModules {
     struct aModuleBackground *background;
     struct aModuleCursor *cursor;
     struct aModuleInput *input;
+    struct aModuleOverlay *overlay;
 #if WITH_XBLIGHT
     float backlight;
 #endif
@@ -84,6 +149,7 @@ struct aModules {
 
 /* authentication modules */
 extern struct aModuleAuth alock_auth_none;
+extern struct aModuleAuth alock_auth_chain;
 #if ENABLE_HASH
 extern struct aModuleAuth alock_auth_hash;
 #endif
@@ -97,9 +163,7 @@ extern struct aModuleAuth alock_auth_pam;
 /* background modules */
 extern struct aModuleBackground alock_bg_none;
 extern struct aModuleBackground alock_bg_blank;
-#if ENABLE_IMLIB2
 extern struct aModuleBackground alock_bg_image;
-#endif
 #if ENABLE_XRENDER
 extern struct aModuleBackground alock_bg_shade;
 #endif
@@ -118,6 +182,19 @@ extern struct aModuleCursor alock_cursor_image;
 /* input modules */
 extern struct aModuleInput alock_input_none;
 extern struct aModuleInput alock_input_frame;
+#if ENABLE_XRENDER
+extern struct aModuleInput alock_input_dots;
+#endif
+
+/* overlay modules */
+extern struct aModuleOverlay alock_overlay_none;
+#if ENABLE_XRENDER
+extern struct aModuleOverlay alock_overlay_status;
+#endif
+
+
+/* composite authentication module setup */
+int alock_auth_chain_append(struct aModuleAuth *module, const char *args);
 
 
 /* dummy functions for module interface */
@@ -129,12 +206,52 @@ void module_dummy_free(void);
 
 /* helper functions defined in utils.c */
 unsigned long alock_mtime(void);
+int alock_parallel(unsigned int count,
+        int (*func)(unsigned int index, void *arg),
+        void *arg);
+int alock_open_user(const char *filename, int flags, mode_t mode);
+int alock_trace_open(const char *filename);
+int alock_trace_begin(const char *name, const char *category);
+void alock_trace_end(int id);
+void alock_trace_arg(int id, const char *name, long value);
+void alock_trace_mark(const char *name, const char *category);
+void alock_trace_close(void);
 int alock_native_byte_order(void);
 int alock_alloc_color(Display *display,
         Colormap colormap,
         const char *color_name,
         const char *fallback_name,
         XColor *result);
+int alock_check_xshm(Display *display);
+XImage *alock_create_image(Display *display,
+        Visual *visual,
+        int depth,
+        unsigned int width,
+        unsigned int height);
+void alock_destroy_image(Display *display, XImage *image);
+int alock_capture_image(Display *display,
+        Drawable drawable,
+        XImage *image,
+        int x, int y,
+        unsigned int height);
+int alock_capture_request(Display *display,
+        struct aCaptureQueue *queue,
+        Drawable drawable,
+        XImage *image,
+        int x, int y,
+        unsigned int height);
+int alock_capture_fetch(Display *display,
+        struct aCaptureQueue *queue,
+        XImage *image);
+void alock_upload_image(Display *display,
+        Drawable drawable,
+        GC gc,
+        XImage *image,
+        int src_x, int src_y,
+        int dst_x, int dst_y,
+        unsigned int width,
+        unsigned int height,
+        const char *module);
 int alock_check_xrender(Display *display);
 int alock_shade_pixmap(Display *display,
         Visual *visual,
@@ -154,9 +271,36 @@ int alock_blur_pixmap(Display *display,
         int dst_x, int dst_y,
         unsigned int width,
         unsigned int height);
+int alock_pixelate_pixmap(Display *display,
+        Visual *visual,
+        Pixmap pixmap,
+        unsigned int size,
+        unsigned int width,
+        unsigned int height);
+int alock_check_xrender_blend(Display *display);
+int alock_grayscale_pixmap(Display *display,
+        Visual *visual,
+        Pixmap pixmap,
+        unsigned int width,
+        unsigned int height);
 int alock_grayscale_image(XImage *image,
         int x, int y,
         unsigned int width,
         unsigned int height);
+int alock_grayscale_shade_image(XImage *image,
+        int x, int y,
+        unsigned int width,
+        unsigned int height,
+        const XColor *tint,
+        unsigned char shade);
+
+/* image helpers defined in image.c */
+int alock_image_decode(struct aImage *image, int fd);
+int alock_image_load(struct aImage *image, const char *filename);
+void alock_image_free(struct aImage *image);
+int alock_image_scale(struct aImage *dst, const struct aImage *src,
+        unsigned int width, unsigned int height, enum aImageFilter filter);
+Pixmap alock_image_pixmap(Display *display, Drawable drawable, Visual *visual,
+        int depth, const struct aImage *image);
 
 #endif /* ALOCK_ALOCK_H_ */
@@ -0,0 +1,313 @@
+/*
+ * alock - auth_chain.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This authentication module provides:
+ *  -auth type:options+type:options[+...]
+ *
+ * Composite module, which runs authentication with all chained modules. When
+ * alock is built with the threads support, every module is run in a separate
+ * worker thread on the same (locked in memory) copy of the password, and the
+ * first success unlocks the screen - slow modules (e.g. network PAM stack) do
+ * not delay fast ones. A failure is reported only when all modules have
+ * failed, so a new attempt never finds a module which is still busy.
+ *
+ * The remaining attempts are not cancelled. Workers of the modules which lost
+ * the race are abandoned - they are left running (and their modules are not
+ * freed) until alock exits, which follows the success right away. Without the
+ * threads support, modules are run one by one in the given order.
+ *
+ */
+
+#include "alock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
+
+
+struct chainEntry {
+    struct aModuleAuth *module;
+    char *args;
+    /* authentication is in progress */
+    int busy;
+};
+
+/* shared password copy, freed by the last user */
+struct chainPass {
+    unsigned int refcount;
+    size_t size;
+    char pass[];
+};
+
+static struct moduleData {
+
+    struct chainEntry entries[4];
+    unsigned int count;
+
+#if ENABLE_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /* sequence number of the current attempt */
+    unsigned int attempt;
+    unsigned int pending;
+    int success;
+#endif
+
+} data = {
+    .count = 0,
+#if ENABLE_THREADS
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+#endif
+};
+
+
+/* Append authentication module to the chain. Given arguments are copied, so
+ * they do not have to be valid after this call. Note, that every module can
+ * be used only once, because modules keep their state in static variables. */
+int alock_auth_chain_append(struct aModuleAuth *module, const char *args) {
+
+    unsigned int i;
+
+    if (data.count == sizeof(data.entries) / sizeof(*data.entries)) {
+        fprintf(stderr, "[chain]: too many authentication modules\n");
+        return -1;
+    }
+
+    for (i = 0; i < data.count; i++)
+        if (data.entries[i].module == module) {
+            fprintf(stderr, "[chain]: module used more than once: %s\n", module->m.name);
+            return -1;
+        }
+
+    data.entries[data.count].module = module;
+    data.entries[data.count].args = strdup(args);
+    data.entries[data.count].busy = 0;
+    data.count++;
+
+    return 0;
+}
+
+static struct chainPass *chain_pass_new(const char *pass) {
+
+    size_t size = sizeof(struct chainPass) + strlen(pass) + 1;
+    struct chainPass *cp;
+
+    if ((cp = calloc(1, size)) == NULL)
+        return NULL;
+
+    mlock(cp, size);
+    cp->refcount = 1;
+    cp->size = size;
+    strcpy(cp->pass, pass);
+
+    return cp;
+}
+
+static void chain_pass_unref(struct chainPass *cp) {
+    if (__atomic_sub_fetch(&cp->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    memset(cp, 0, cp->size);
+    munlock(cp, cp->size);
+    free(cp);
+}
+
+#if ENABLE_THREADS
+
+struct chainWorker {
+    struct chainEntry *entry;
+    struct chainPass *pass;
+    unsigned int attempt;
+};
+
+static void *chain_worker(void *arg) {
+
+    struct chainWorker *w = (struct chainWorker *)arg;
+    int trace;
+    int rv;
+
+    trace = alock_trace_begin("auth.authenticate", w->entry->module->m.name);
+    rv = w->entry->module->authenticate(w->pass->pass);
+    alock_trace_end(trace);
+
+    chain_pass_unref(w->pass);
+
+    pthread_mutex_lock(&data.mutex);
+
+    /* result of the abandoned attempt is not interesting */
+    if (w->attempt == data.attempt) {
+        data.pending--;
+        if (rv == 0)
+            data.success = 1;
+        pthread_cond_signal(&data.cond);
+    }
+
+    w->entry->busy = 0;
+    pthread_mutex_unlock(&data.mutex);
+
+    free(w);
+    return NULL;
+}
+
+#endif /* ENABLE_THREADS */
+
+static void module_loadargs(const char *args) {
+    (void)args;
+
+    unsigned int i;
+    for (i = 0; i < data.count; i++)
+        data.entries[i].module->m.loadargs(data.entries[i].args);
+}
+
+static void module_loadxrdb(XrmDatabase xrdb) {
+    unsigned int i;
+    for (i = 0; i < data.count; i++)
+        data.entries[i].module->m.loadxrdb(xrdb);
+}
+
+static int module_init(Display *dpy) {
+
+    unsigned int i;
+    int rv = 0;
+
+    for (i = 0; i < data.count; i++)
+        if (data.entries[i].module->m.init(dpy) != 0) {
+            fprintf(stderr, "[chain]: failed init of [%s] with [%s]\n",
+                    data.entries[i].module->m.name, data.entries[i].args);
+            rv = -1;
+        }
+
+    return rv;
+}
+
+static void module_free(void) {
+
+    unsigned int i;
+
+    for (i = 0; i < data.count; i++) {
+#if ENABLE_THREADS
+        int busy;
+        pthread_mutex_lock(&data.mutex);
+        busy = data.entries[i].busy;
+        pthread_mutex_unlock(&data.mutex);
+        /* Module which is still processing an abandoned attempt can not be
+         * freed safely. Leave it as it is - we are about to exit anyway. */
+        if (busy) {
+            debug("abandoned authentication: %s", data.entries[i].module->m.name);
+            continue;
+        }
+#endif
+        data.entries[i].module->m.free();
+        free(data.entries[i].args);
+        data.entries[i].args = NULL;
+    }
+
+}
+
+static int module_authenticate(const char *pass) {
+
+    struct chainPass *cp;
+    unsigned int i;
+    int rv = -1;
+
+    if (pass == NULL)
+        return -1;
+
+    /* there is nothing to parallelize */
+    if (data.count == 1)
+        return data.entries[0].module->authenticate(pass);
+
+    if ((cp = chain_pass_new(pass)) == NULL)
+        return -1;
+
+#if ENABLE_THREADS
+
+    pthread_mutex_lock(&data.mutex);
+
+    data.attempt++;
+    data.pending = 0;
+    data.success = 0;
+
+    for (i = 0; i < data.count; i++) {
+
+        struct chainWorker *w;
+        pthread_attr_t attr;
+        pthread_t thread;
+
+        if ((w = malloc(sizeof(*w))) == NULL)
+            continue;
+
+        w->entry = &data.entries[i];
+        w->pass = cp;
+        w->attempt = data.attempt;
+        __atomic_add_fetch(&cp->refcount, 1, __ATOMIC_RELAXED);
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, chain_worker, w) != 0) {
+            chain_pass_unref(cp);
+            free(w);
+        }
+        else {
+            data.entries[i].busy = 1;
+            data.pending++;
+        }
+        pthread_attr_destroy(&attr);
+
+    }
+
+    /* wait for the first success or for all failures */
+    while (data.pending > 0 && !data.success)
+        pthread_cond_wait(&data.cond, &data.mutex);
+
+    if (data.success)
+        rv = 0;
+
+    /* mark the attempt as finished, so the late results will be ignored */
+    data.attempt++;
+
+    pthread_mutex_unlock(&data.mutex);
+
+#else
+
+    for (i = 0; i < data.count; i++)
+        if ((rv = data.entries[i].module->authenticate(cp->pass)) == 0)
+            break;
+
+#endif
+
+    chain_pass_unref(cp);
+    return rv;
+}
+
+static int module_verify(const char *pass) {
+
+    unsigned int i;
+
+    for (i = 0; i < data.count; i++)
+        if (data.entries[i].module->verify != NULL &&
+                data.entries[i].module->verify(pass) == 0)
+            return 0;
+
+    return -1;
+}
+
+
+struct aModuleAuth alock_auth_chain = {
+    { "chain",
+        module_loadargs,
+        module_loadxrdb,
+        module_init,
+        module_free,
+    },
+    module_authenticate,
+    module_verify,
+};
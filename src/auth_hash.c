@@ -8,6 +8,8 @@
  *
  * This authentication module provides:
  *  -auth hash:type=<type>,hash=<hash>,file=<filename>
+ *  -auth hash:kdf=<kdf>,salt=<salt>,iter=<int>,cost=<int>,mem=<int>,par=<int>,
+ *             hash=<hash>,file=<filename>,calibrate=<ms>,generate
  *
  */
 
@@ -17,10 +19,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <gcrypt.h>
 
 
 #define HASH_DIGEST_MAX_LEN 64
+#define HASH_SALT_MAX_LEN 64
 static int algorithms[] = {
     GCRY_MD_MD5,
     GCRY_MD_SHA1,
@@ -30,10 +34,45 @@ static int algorithms[] = {
     GCRY_MD_WHIRLPOOL,
 };
 
+/* key derivation functions (slow hashes) */
+enum kdfType {
+    KDF_NONE = 0,
+    KDF_PBKDF2,
+    KDF_SCRYPT,
+    KDF_ARGON2,
+};
+
+static const char *kdf_names[] = {
+    [KDF_NONE] = "none",
+    [KDF_PBKDF2] = "pbkdf2",
+    [KDF_SCRYPT] = "scrypt",
+#if HAVE_DECL_GCRY_KDF_ARGON2
+    [KDF_ARGON2] = "argon2",
+#endif
+};
+
 static struct moduleData {
     int selected_algorithm;
     int selected_digest_len;
+    enum kdfType kdf;
+    /* PBKDF2 iterations or Argon2 time cost */
+    unsigned long iterations;
+    /* scrypt CPU/memory cost (N) */
+    unsigned long cost;
+    /* Argon2 memory cost in KiB */
+    unsigned long memory;
+    /* scrypt or Argon2 parallelism */
+    unsigned long parallelism;
+    unsigned char salt[HASH_SALT_MAX_LEN];
+    int salt_len;
+    /* calibration target in milliseconds */
+    unsigned int calibrate;
+    int generate;
     unsigned char *user_digest;
+    /* preallocated buffers for the tested digest - the verification has its
+     * own one, because it might run concurrently with the authentication */
+    unsigned char *test_digest;
+    unsigned char *verify_digest;
     char *user_hash;
 } data = { 0 };
 
@@ -62,7 +101,6 @@ static unsigned char *hex2mem(unsigned char *mem, const char *str, int len) {
     return mem;
 }
 
-#if DEBUG
 static char *mem2hex(char *str, const unsigned char *mem, int len) {
 
     char hexchars[] = "0123456789abcdef", *ptr;
@@ -75,7 +113,212 @@ static char *mem2hex(char *str, const unsigned char *mem, int len) {
     *ptr = 0;
     return str;
 }
+
+/* Compare memory areas in a constant time. This function returns 0 if the
+ * given areas are equal, otherwise 1. */
+static int memcmp_ct(const unsigned char *a, const unsigned char *b, size_t len) {
+
+    volatile unsigned char diff = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        diff |= a[i] ^ b[i];
+
+    return diff != 0;
+}
+
+/* Compute digest of the given password using selected algorithm or KDF. This
+ * function returns 0 on success, otherwise -1. */
+static int derive(const char *pass, unsigned char *digest, size_t len) {
+
+    gpg_error_t err = 0;
+
+    switch (data.kdf) {
+    case KDF_NONE:
+        gcry_md_hash_buffer(data.selected_algorithm, digest, pass, strlen(pass));
+        break;
+    case KDF_PBKDF2:
+        err = gcry_kdf_derive(pass, strlen(pass), GCRY_KDF_PBKDF2, data.selected_algorithm,
+                data.salt, data.salt_len, data.iterations, len, digest);
+        break;
+    case KDF_SCRYPT:
+        err = gcry_kdf_derive(pass, strlen(pass), GCRY_KDF_SCRYPT, data.cost,
+                data.salt, data.salt_len, data.parallelism, len, digest);
+        break;
+    case KDF_ARGON2: {
+#if HAVE_DECL_GCRY_KDF_ARGON2
+        unsigned long params[4] = { len, data.iterations, data.memory, data.parallelism };
+        gcry_kdf_hd_t hd;
+        if ((err = gcry_kdf_open(&hd, GCRY_KDF_ARGON2, GCRY_KDF_ARGON2ID, params, 4,
+                        pass, strlen(pass), data.salt, data.salt_len, NULL, 0, NULL, 0)) == 0) {
+            if ((err = gcry_kdf_compute(hd, NULL)) == 0)
+                err = gcry_kdf_final(hd, len, digest);
+            gcry_kdf_close(hd);
+        }
+#else
+        err = GPG_ERR_NOT_SUPPORTED;
 #endif
+        break;
+    }
+    }
+
+    if (err) {
+        fprintf(stderr, "[hash]: key derivation failed: %s\n", gcry_strerror(err));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Set default parameters for the selected KDF. */
+static void kdf_defaults(void) {
+    if (data.kdf == KDF_PBKDF2 && data.selected_algorithm == 0)
+        data.selected_algorithm = GCRY_MD_SHA256;
+    if (data.kdf == KDF_SCRYPT && data.cost == 0)
+        data.cost = 16384;
+    if (data.kdf == KDF_ARGON2 && data.memory == 0)
+        data.memory = 65536;
+    if (data.iterations == 0)
+        data.iterations = data.kdf == KDF_ARGON2 ? 3 : 100000;
+    if (data.parallelism == 0)
+        data.parallelism = 1;
+}
+
+/* Get the length of the digest for the current configuration. */
+static int kdf_digest_len(void) {
+    if (data.kdf == KDF_NONE || data.kdf == KDF_PBKDF2)
+        return gcry_md_get_algo_dlen(data.selected_algorithm);
+    return 32;
+}
+
+/* Print module arguments for the current KDF configuration. */
+static void kdf_print_args(void) {
+
+    char salt[HASH_SALT_MAX_LEN * 2 + 1];
+
+    printf("kdf=%s,", kdf_names[data.kdf]);
+    switch (data.kdf) {
+    case KDF_NONE:
+        break;
+    case KDF_PBKDF2:
+        printf("type=%s,iter=%lu,", gcry_md_algo_name(data.selected_algorithm), data.iterations);
+        break;
+    case KDF_SCRYPT:
+        printf("cost=%lu,par=%lu,", data.cost, data.parallelism);
+        break;
+    case KDF_ARGON2:
+        printf("iter=%lu,mem=%lu,par=%lu,", data.iterations, data.memory, data.parallelism);
+        break;
+    }
+    printf("salt=%s", mem2hex(salt, data.salt, data.salt_len));
+
+}
+
+/* Measure the time (in milliseconds) of a single key derivation. */
+static unsigned long kdf_measure(void) {
+
+    unsigned char digest[HASH_DIGEST_MAX_LEN];
+    unsigned long t0 = alock_mtime();
+
+    if (derive("alock-calibration", digest, kdf_digest_len()) == -1)
+        exit(EXIT_FAILURE);
+
+    return alock_mtime() - t0;
+}
+
+/* Find KDF cost parameters which will result in the authentication latency
+ * close to the given target on this machine. Found parameters (and random
+ * salt) are printed in the format accepted by this module. */
+static void module_cmd_calibrate(unsigned int target) {
+
+    unsigned long t;
+
+    gcry_check_version(NULL);
+
+    if (data.kdf == KDF_NONE)
+        data.kdf = KDF_PBKDF2;
+    kdf_defaults();
+
+    if (data.salt_len == 0) {
+        data.salt_len = 16;
+        gcry_randomize(data.salt, data.salt_len, GCRY_STRONG_RANDOM);
+    }
+
+    switch (data.kdf) {
+    case KDF_NONE:
+    case KDF_PBKDF2:
+        /* derivation time is linear in the number of iterations, however
+         * for the sake of accuracy, the measurement should not be too short */
+        for (data.iterations = 1000; (t = kdf_measure()) < 50 && t < target; )
+            data.iterations *= 2;
+        data.iterations = data.iterations * target / (t ? t : 1);
+        break;
+    case KDF_SCRYPT:
+        /* cost has to be a power of 2 */
+        for (data.cost = 1024; kdf_measure() * 2 <= target; )
+            data.cost *= 2;
+        break;
+    case KDF_ARGON2:
+        /* use default amount of memory and increase time cost, unless
+         * single pass with such memory is already too expensive */
+        for (data.iterations = 1; (t = kdf_measure()) > target && data.memory > 1024; )
+            data.memory /= 2;
+        if (t > 0)
+            data.iterations = target / t;
+        if (data.iterations == 0)
+            data.iterations = 1;
+        break;
+    }
+
+    t = kdf_measure();
+    printf("calibrated parameters (%lu ms):\n  ", t);
+    kdf_print_args();
+    printf("\n");
+
+}
+
+/* Read password from the standard input and print module arguments with
+ * the hash computed for the current configuration. */
+static void module_cmd_generate(void) {
+
+    unsigned char digest[HASH_DIGEST_MAX_LEN];
+    char hash[HASH_DIGEST_MAX_LEN * 2 + 1];
+    char pass[128];
+    size_t len;
+    int dlen;
+
+    gcry_check_version(NULL);
+
+    if (data.kdf == KDF_NONE && data.selected_algorithm == 0) {
+        fprintf(stderr, "[hash]: invalid or not specified type\n");
+        exit(EXIT_FAILURE);
+    }
+    if (data.kdf != KDF_NONE && data.salt_len == 0) {
+        data.salt_len = 16;
+        gcry_randomize(data.salt, data.salt_len, GCRY_STRONG_RANDOM);
+    }
+
+    kdf_defaults();
+    dlen = kdf_digest_len();
+
+    if (fgets(pass, sizeof(pass), stdin) == NULL)
+        exit(EXIT_FAILURE);
+    if ((len = strlen(pass)) > 0 && pass[len - 1] == '\n')
+        pass[len - 1] = '\0';
+
+    if (derive(pass, digest, dlen) == -1)
+        exit(EXIT_FAILURE);
+    memset(pass, 0, sizeof(pass));
+
+    if (data.kdf == KDF_NONE)
+        printf("type=%s,", gcry_md_algo_name(data.selected_algorithm));
+    else {
+        kdf_print_args();
+        printf(",");
+    }
+    printf("hash=%s\n", mem2hex(hash, digest, dlen));
+
+}
 
 static void module_cmd_list(void) {
 
@@ -86,6 +329,11 @@ static void module_cmd_list(void) {
         if (gcry_md_test_algo(algorithms[i]) == 0)
             printf("  %s\n", gcry_md_algo_name(algorithms[i]));
 
+    printf("list of available key derivation functions:\n");
+    for (i = KDF_PBKDF2; i < sizeof(kdf_names) / sizeof(*kdf_names); i++)
+        if (kdf_names[i] != NULL)
+            printf("  %s\n", kdf_names[i]);
+
 }
 
 static void module_loadargs(const char *args) {
@@ -106,6 +354,41 @@ static void module_loadargs(const char *args) {
         if (strstr(arg, "type=") == arg) {
             data.selected_algorithm = gcry_md_map_name(&arg[5]);
         }
+        else if (strstr(arg, "kdf=") == arg) {
+            unsigned int i;
+            data.kdf = KDF_NONE;
+            for (i = KDF_PBKDF2; i < sizeof(kdf_names) / sizeof(*kdf_names); i++)
+                if (kdf_names[i] != NULL && strcmp(&arg[4], kdf_names[i]) == 0)
+                    data.kdf = i;
+            if (data.kdf == KDF_NONE)
+                fprintf(stderr, "[hash]: unsupported key derivation function: %s\n", &arg[4]);
+        }
+        else if (strstr(arg, "salt=") == arg) {
+            data.salt_len = strlen(&arg[5]) / 2;
+            if (data.salt_len > HASH_SALT_MAX_LEN ||
+                    hex2mem(data.salt, &arg[5], data.salt_len * 2) == NULL) {
+                fprintf(stderr, "[hash]: invalid salt\n");
+                data.salt_len = 0;
+            }
+        }
+        else if (strstr(arg, "iter=") == arg) {
+            data.iterations = strtoul(&arg[5], NULL, 0);
+        }
+        else if (strstr(arg, "cost=") == arg) {
+            data.cost = strtoul(&arg[5], NULL, 0);
+        }
+        else if (strstr(arg, "mem=") == arg) {
+            data.memory = strtoul(&arg[4], NULL, 0);
+        }
+        else if (strstr(arg, "par=") == arg) {
+            data.parallelism = strtoul(&arg[4], NULL, 0);
+        }
+        else if (strstr(arg, "calibrate=") == arg) {
+            data.calibrate = strtoul(&arg[10], NULL, 0);
+        }
+        else if (strcmp(arg, "generate") == 0) {
+            data.generate = 1;
+        }
         else if (strstr(arg, "hash=") == arg) {
             free(data.user_hash);
             data.user_hash = strdup(&arg[5]);
@@ -134,6 +417,16 @@ static void module_loadargs(const char *args) {
         }
     }
 
+    /* commands which depend on other arguments */
+    if (data.calibrate) {
+        module_cmd_calibrate(data.calibrate);
+        exit(EXIT_SUCCESS);
+    }
+    if (data.generate) {
+        module_cmd_generate();
+        exit(EXIT_SUCCESS);
+    }
+
 return_error:
     free(arguments);
 }
@@ -143,11 +436,16 @@ static int module_init(Display *display) {
 
     int len;
 
-    if (data.selected_algorithm == 0) {
+    if (data.kdf == KDF_NONE && data.selected_algorithm == 0) {
         fprintf(stderr, "[hash]: invalid or not specified type\n");
         return -1;
     }
 
+    if (data.kdf != KDF_NONE && data.salt_len == 0) {
+        fprintf(stderr, "[hash]: salt not specified\n");
+        return -1;
+    }
+
     if (data.user_hash == NULL) {
         fprintf(stderr, "[hash]: not specified hash nor file\n");
         return -1;
@@ -156,52 +454,84 @@ static int module_init(Display *display) {
     /* initialize gcrypt subsystem */
     gcry_check_version(NULL);
 
-    data.selected_digest_len = gcry_md_get_algo_dlen(data.selected_algorithm);
+    kdf_defaults();
     len = strlen(data.user_hash);
 
-    if (data.selected_digest_len * 2 > len) {
-        fprintf(stderr, "[hash]: incorrect hash for given type\n");
-        return -1;
+    if (data.kdf == KDF_NONE) {
+        data.selected_digest_len = gcry_md_get_algo_dlen(data.selected_algorithm);
+        if (data.selected_digest_len * 2 > len) {
+            fprintf(stderr, "[hash]: incorrect hash for given type\n");
+            return -1;
+        }
+    }
+    else {
+        /* derived key has the length of the given hash */
+        data.selected_digest_len = len / 2;
+        if (data.selected_digest_len == 0 || data.selected_digest_len > HASH_DIGEST_MAX_LEN) {
+            fprintf(stderr, "[hash]: incorrect hash length\n");
+            return -1;
+        }
     }
 
-    data.user_digest = (unsigned char *)malloc(data.selected_digest_len);
-    hex2mem(data.user_digest, data.user_hash, data.selected_digest_len * 2);
+    /* Allocate buffers upfront, so the authentication itself will not
+     * allocate any memory. If possible, do not swap them out. */
+    data.user_digest = (unsigned char *)malloc(data.selected_digest_len * 3);
+    data.test_digest = data.user_digest + data.selected_digest_len;
+    data.verify_digest = data.test_digest + data.selected_digest_len;
+    mlock(data.user_digest, data.selected_digest_len * 3);
+
+    if (hex2mem(data.user_digest, data.user_hash, data.selected_digest_len * 2) == NULL) {
+        fprintf(stderr, "[hash]: incorrect hash\n");
+        return -1;
+    }
 
     return 0;
 }
 
 static void module_free(void) {
+    if (data.user_digest != NULL) {
+        memset(data.user_digest, 0, data.selected_digest_len * 3);
+        munlock(data.user_digest, data.selected_digest_len * 3);
+    }
     free(data.user_digest);
-    data.user_digest = NULL;
     free(data.user_hash);
-    data.user_hash = NULL;
+    /* reset module to its initial state */
+    memset(&data, 0, sizeof(data));
 }
 
-static int module_authenticate(const char *pass) {
+/* Compare the digest of the given password with the user one. The tested
+ * digest is derived into the given buffer. */
+static int compare(const char *pass, unsigned char *test_digest) {
 
-    if (data.selected_algorithm == 0)
+    if (data.user_digest == NULL)
         return -1;
 
-    unsigned char *digest;
-
-    digest = (unsigned char *)malloc(data.selected_digest_len);
-    gcry_md_hash_buffer(data.selected_algorithm, digest, pass, strlen(pass));
+    if (derive(pass, test_digest, data.selected_digest_len) == -1)
+        return -1;
 
 #if DEBUG
     char user_hash[HASH_DIGEST_MAX_LEN * 2 + 1];
     char test_hash[HASH_DIGEST_MAX_LEN * 2 + 1];
     mem2hex(user_hash, data.user_digest, data.selected_digest_len);
-    mem2hex(test_hash, digest, data.selected_digest_len);
-    debug("user hash: %s", data.user_hash);
+    mem2hex(test_hash, test_digest, data.selected_digest_len);
+    debug("user hash: %s", user_hash);
     debug("test hash: %s", test_hash);
 #endif
 
-    int status = memcmp(data.user_digest, digest, data.selected_digest_len);
-    free(digest);
+    int status = memcmp_ct(data.user_digest, test_digest, data.selected_digest_len);
+    memset(test_digest, 0, data.selected_digest_len);
 
     return status;
 }
 
+static int module_authenticate(const char *pass) {
+    return compare(pass, data.test_digest);
+}
+
+static int module_verify(const char *pass) {
+    return compare(pass, data.verify_digest);
+}
+
 
 struct aModuleAuth alock_auth_hash = {
     { "hash",
@@ -211,4 +541,5 @@ struct aModuleAuth alock_auth_hash = {
         module_free,
     },
     module_authenticate,
+    module_verify,
 };
@@ -29,4 +29,5 @@ struct aModuleAuth alock_auth_none = {
         module_dummy_free,
     },
     module_authenticate,
+    NULL,
 };
@@ -9,7 +9,7 @@
  * This project is licensed under the terms of the MIT license.
  *
  * This authentication module provides:
- *  -auth pam:service=<service>
+ *  -auth pam:service=<service>,warm,cache=<file>
  *
  */
 
@@ -19,15 +19,61 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <security/pam_appl.h>
+#if ENABLE_HASH
+# include <gcrypt.h>
+#endif
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
 
 
 static const char *username = NULL;
 static const char *password = NULL;
 static char *service = NULL;
+static char *tty = NULL;
+
+/* When enabled, PAM transaction is started during the module initialization
+ * and it is reused for all authentication attempts. This way the module
+ * stack is loaded (and e.g. network connections are established) only once
+ * instead of once per every attempt. */
+static int warm = 0;
+static pam_handle_t *warm_handle = NULL;
+
+/* Local verifier cache. After a successful PAM authentication, the salted
+ * scrypt digest of the password is stored in the file, so the next lock can
+ * verify the password without waiting for the PAM stack (e.g. LDAP or the
+ * Kerberos server). The password accepted by the cache is verified by PAM in
+ * the module free(), i.e. after the screen has been unlocked, and the cache
+ * is refreshed or invalidated accordingly. The speculative verification
+ * might check the cache concurrently with the authentication, so the cache
+ * content and the pending password are guarded by the mutex. */
+static struct pamCache {
+#if ENABLE_THREADS
+    pthread_mutex_t mutex;
+#endif
+    int enabled;
+    char *file;
+    int fd;
+    int valid;
+    unsigned long cost;
+    unsigned char salt[16];
+    unsigned char digest[32];
+    /* password accepted by the cache */
+    char *pending;
+    size_t pending_size;
+} cache = {
+#if ENABLE_THREADS
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    .fd = -1,
+    .cost = 16384,
+};
 
 
 static int alock_auth_pam_conv(int num_msg,
@@ -63,10 +109,297 @@ static int alock_auth_pam_conv(int num_msg,
     return PAM_SUCCESS;
 }
 
+/* Start new PAM transaction for the current user. */
+static int transaction_start(pam_handle_t **handle) {
+
+    static const struct pam_conv conv = {
+        &alock_auth_pam_conv, NULL
+    };
+    int retval;
+
+    *handle = NULL;
+    if ((retval = pam_start(service, username, &conv, handle)) == PAM_SUCCESS)
+        retval = pam_set_item(*handle, PAM_TTY, tty);
+
+    if (retval != PAM_SUCCESS && *handle != NULL) {
+        pam_end(*handle, retval);
+        *handle = NULL;
+    }
+
+    return retval;
+}
+
+/* Authenticate given password with the PAM stack. This function returns
+ * the status code of the PAM library. */
+static int pam_verify(const char *pass) {
+
+    pam_handle_t *pam_handle = NULL;
+    int retval;
+
+    password = pass;
+
+    if (warm) {
+
+        retval = PAM_SUCCESS;
+        if (warm_handle == NULL)
+            retval = transaction_start(&warm_handle);
+        else
+            /* Make sure, that the token from the previous attempt will not
+             * be reused by modules in the stack. Linux-PAM does not allow
+             * applications to set this item (PAM_BAD_ITEM is returned), but
+             * it clears the token by itself after every pam_authenticate(),
+             * so the result is ignored. */
+            pam_set_item(warm_handle, PAM_AUTHTOK, NULL);
+
+        if (retval == PAM_SUCCESS)
+            retval = pam_authenticate(warm_handle, 0);
+
+        /* Keep transaction alive upon the authentication failure, however
+         * if something more serious has happened, start a new one during
+         * the next attempt. */
+        if (retval != PAM_SUCCESS && retval != PAM_AUTH_ERR && warm_handle != NULL) {
+            pam_end(warm_handle, retval);
+            warm_handle = NULL;
+        }
+
+    }
+    else {
+        if ((retval = transaction_start(&pam_handle)) == PAM_SUCCESS)
+            retval = pam_authenticate(pam_handle, 0);
+        if (pam_handle != NULL)
+            pam_end(pam_handle, retval);
+    }
+
+    password = NULL;
+    return retval;
+}
+
+#if ENABLE_HASH
+
+static void cache_lock(void) {
+#if ENABLE_THREADS
+    pthread_mutex_lock(&cache.mutex);
+#endif
+}
+
+static void cache_unlock(void) {
+#if ENABLE_THREADS
+    pthread_mutex_unlock(&cache.mutex);
+#endif
+}
+
+/* Compute cache digest of the given password. */
+static int cache_derive(const char *pass, unsigned long cost,
+        const unsigned char *salt, unsigned char *digest) {
+    return gcry_kdf_derive(pass, strlen(pass), GCRY_KDF_SCRYPT, cost,
+            salt, sizeof(cache.salt), 1, sizeof(cache.digest), digest);
+}
+
+/* Write cache content into the file. An empty file means no cache. */
+static void cache_save(void) {
+
+    char buffer[256];
+    size_t i;
+    int n = 0;
+
+    if (cache.fd == -1)
+        return;
+
+    if (cache.valid) {
+        n = snprintf(buffer, sizeof(buffer), "scrypt:%lu:", cache.cost);
+        for (i = 0; i < sizeof(cache.salt); i++)
+            n += sprintf(&buffer[n], "%02x", cache.salt[i]);
+        buffer[n++] = ':';
+        for (i = 0; i < sizeof(cache.digest); i++)
+            n += sprintf(&buffer[n], "%02x", cache.digest[i]);
+        buffer[n++] = '\n';
+    }
+
+    if (ftruncate(cache.fd, 0) == -1 ||
+            (n && pwrite(cache.fd, buffer, n, 0) != n) ||
+            fsync(cache.fd) == -1)
+        perror("[pam]: unable to write cache");
+
+}
+
+/* Load cache content from the file. An empty file is a valid (but empty)
+ * cache. This function returns -1 if the file content is not a cache. */
+static int cache_load(void) {
+
+    char buffer[256];
+    char salt[sizeof(cache.salt) * 2 + 1];
+    char digest[sizeof(cache.digest) * 2 + 1];
+    unsigned int x;
+    ssize_t len;
+    size_t i;
+
+    if ((len = pread(cache.fd, buffer, sizeof(buffer) - 1, 0)) <= 0)
+        return len;
+    buffer[len] = '\0';
+
+    if (sscanf(buffer, "scrypt:%lu:%32[0-9a-f]:%64[0-9a-f]", &cache.cost, salt, digest) != 3 ||
+            strlen(salt) != sizeof(salt) - 1 || strlen(digest) != sizeof(digest) - 1 ||
+            cache.cost == 0 || strchr(buffer, '\n') != &buffer[len - 1]) {
+        cache.cost = 16384;
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(cache.salt); i++) {
+        sscanf(&salt[i * 2], "%2x", &x);
+        cache.salt[i] = x;
+    }
+    for (i = 0; i < sizeof(cache.digest); i++) {
+        sscanf(&digest[i * 2], "%2x", &x);
+        cache.digest[i] = x;
+    }
+
+    cache.valid = 1;
+    memset(buffer, 0, sizeof(buffer));
+    memset(digest, 0, sizeof(digest));
+    return 0;
+}
+
+/* Open cache file. The file name is given by the user, so it is opened
+ * (and created if needed) with the rights of the real user, even if we are
+ * installed setuid root. The file shall be owned by that user and it shall
+ * be accessible by its owner only. A file with a content which is not a
+ * cache is never rewritten. */
+static int cache_open(void) {
+
+    struct stat st;
+
+    if ((cache.fd = alock_open_user(cache.file, O_RDWR | O_CREAT | O_NOFOLLOW, 0600)) == -1) {
+        perror("[pam]: unable to open cache file");
+        return -1;
+    }
+
+    if (fstat(cache.fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+            st.st_uid != getuid() || (st.st_mode & 077) != 0) {
+        fprintf(stderr, "[pam]: insecure cache file: %s\n", cache.file);
+        goto fail;
+    }
+
+    if (cache_load() == -1) {
+        fprintf(stderr, "[pam]: invalid cache file: %s\n", cache.file);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    close(cache.fd);
+    cache.fd = -1;
+    return -1;
+}
+
+/* Store the digest of the password verified by the PAM stack. */
+static void cache_update(const char *pass) {
+
+    unsigned char salt[sizeof(cache.salt)];
+    unsigned char digest[sizeof(cache.digest)];
+    int valid;
+
+    gcry_randomize(salt, sizeof(salt), GCRY_STRONG_RANDOM);
+    valid = cache_derive(pass, cache.cost, salt, digest) == 0;
+
+    cache_lock();
+    memcpy(cache.salt, salt, sizeof(salt));
+    memcpy(cache.digest, digest, sizeof(digest));
+    cache.valid = valid;
+    cache_save();
+    cache_unlock();
+
+    memset(digest, 0, sizeof(digest));
+}
+
+static void cache_invalidate(void) {
+    cache_lock();
+    cache.valid = 0;
+    memset(cache.digest, 0, sizeof(cache.digest));
+    cache_save();
+    cache_unlock();
+}
+
+/* Check given password against the cache. This function returns 0 upon
+ * match, otherwise -1. The key is derived from the snapshot of the cache, so
+ * the lock is not held during the (slow) derivation. */
+static int cache_check(const char *pass) {
+
+    unsigned char salt[sizeof(cache.salt)];
+    unsigned char digest[sizeof(cache.digest)];
+    unsigned char test[sizeof(cache.digest)];
+    volatile unsigned char diff = 0;
+    unsigned long cost;
+    size_t i;
+    int valid;
+
+    cache_lock();
+    valid = cache.valid;
+    cost = cache.cost;
+    memcpy(salt, cache.salt, sizeof(salt));
+    memcpy(digest, cache.digest, sizeof(digest));
+    cache_unlock();
+
+    if (!valid || cache_derive(pass, cost, salt, test) != 0)
+        return -1;
+
+    for (i = 0; i < sizeof(digest); i++)
+        diff |= digest[i] ^ test[i];
+
+    memset(digest, 0, sizeof(digest));
+    memset(test, 0, sizeof(test));
+    return diff == 0 ? 0 : -1;
+}
+
+static void cache_set_pending(const char *pass) {
+
+    cache_lock();
+
+    if (cache.pending != NULL) {
+        memset(cache.pending, 0, cache.pending_size);
+        munlock(cache.pending, cache.pending_size);
+        free(cache.pending);
+        cache.pending = NULL;
+    }
+
+    if (pass != NULL) {
+        cache.pending_size = strlen(pass) + 1;
+        if ((cache.pending = malloc(cache.pending_size)) != NULL) {
+            mlock(cache.pending, cache.pending_size);
+            memcpy(cache.pending, pass, cache.pending_size);
+        }
+    }
+
+    cache_unlock();
+}
+
+/* Verify password accepted by the cache with the PAM stack. If the stack is
+ * not available (e.g. the network is down), the cache is left untouched. */
+static void cache_refresh(void) {
+
+    int retval;
+
+    if (cache.pending == NULL)
+        return;
+
+    debug("refreshing PAM verifier cache");
+    if ((retval = pam_verify(cache.pending)) == PAM_SUCCESS)
+        cache_update(cache.pending);
+    else if (retval == PAM_AUTH_ERR) {
+        fprintf(stderr, "[pam]: cached password rejected, invalidating cache\n");
+        cache_invalidate();
+    }
+
+    cache_set_pending(NULL);
+}
+
+#endif /* ENABLE_HASH */
+
 static int module_init(Display *display) {
     (void)display;
 
     struct passwd *pwd;
+    const char *name;
 
     errno = 0;
     if (!(pwd = getpwuid(getuid()))) {
@@ -75,6 +408,31 @@ static int module_init(Display *display) {
     }
 
     username = pwd->pw_name;
+
+    /* terminal name does not change during our lifetime */
+    if ((name = ttyname(0)) != NULL)
+        tty = strdup(name);
+
+    if (warm) {
+        int retval;
+        if ((retval = transaction_start(&warm_handle)) != PAM_SUCCESS)
+            /* not fatal, we will try again upon authentication */
+            fprintf(stderr, "[pam]: unable to start transaction: %s\n",
+                    pam_strerror(NULL, retval));
+    }
+
+#if ENABLE_HASH
+    if (cache.enabled) {
+        gcry_check_version(NULL);
+        mlock(&cache, sizeof(cache));
+        /* cache is optional, failure is not fatal */
+        if (cache_open() == -1) {
+            fprintf(stderr, "[pam]: verifier cache disabled\n");
+            cache.enabled = 0;
+        }
+    }
+#endif
+
     return 0;
 }
 
@@ -83,27 +441,49 @@ static int module_authenticate(const char *pass) {
     if (!username)
         return -1;
 
-    pam_handle_t *pam_handle = NULL;
-    struct pam_conv conv = {
-        &alock_auth_pam_conv, NULL
-    };
-    int retval;
+#if ENABLE_HASH
+    if (cache.enabled) {
 
-    password = pass;
-    retval = pam_start(service, username, &conv, &pam_handle);
+        if (cache_check(pass) == 0) {
+            cache_set_pending(pass);
+            return 0;
+        }
+
+        if (pam_verify(pass) != PAM_SUCCESS)
+            return -1;
+
+        cache_update(pass);
+        /* the cache is fresh, forget the password accepted speculatively */
+        cache_set_pending(NULL);
+        return 0;
+    }
+#endif
 
-    if (retval == PAM_SUCCESS)
-        retval = pam_set_item(pam_handle, PAM_TTY, ttyname(0));
-    if (retval == PAM_SUCCESS)
-        retval = pam_authenticate(pam_handle, 0);
+    return !(pam_verify(pass) == PAM_SUCCESS);
+}
 
-    pam_end(pam_handle, retval);
-    return !(retval == PAM_SUCCESS);
+/* Only the local verifier cache can be used without the side effects, e.g.
+ * PAM stack might record failed attempts. Password accepted by the cache is
+ * remembered, so the cache will be refreshed even if the screen is unlocked
+ * with the result of this (speculative) verification. */
+static int module_verify(const char *pass) {
+#if ENABLE_HASH
+    if (cache.enabled && cache_check(pass) == 0) {
+        cache_set_pending(pass);
+        return 0;
+    }
+#else
+    (void)pass;
+#endif
+    return -1;
 }
 
 static void module_cmd_list(void) {
     printf("list of available PAM module options:\n"
-           "  service=NAME\tService name to use under /etc/pam.d/ to authenticate\n");
+           "  service=NAME\tService name to use under /etc/pam.d/ to authenticate\n"
+           "  warm\t\tStart PAM transaction once and reuse it for all attempts\n"
+           "  cache=FILE\tVerify password locally with the cache of the last\n"
+           "\t\tsuccessful authentication stored in FILE\n");
 }
 
 static void module_loadargs(const char *args) {
@@ -128,14 +508,47 @@ static void module_loadargs(const char *args) {
             free(service);
             service = strdup(&arg[8]);
         }
+        else if (strcmp(arg, "warm") == 0) {
+            warm = 1;
+        }
+        else if (strcmp(arg, "cache") == 0 || strcmp(arg, "cache=") == 0) {
+            fprintf(stderr, "[pam]: verifier cache requires a file: cache=<file>\n");
+        }
+        else if (strstr(arg, "cache=") == arg) {
+#if ENABLE_HASH
+            cache.enabled = 1;
+            free(cache.file);
+            cache.file = strdup(&arg[6]);
+#else
+            fprintf(stderr, "[pam]: verifier cache requires gcrypt support\n");
+#endif
+        }
     }
 
     free(arguments);
 }
 
 static void module_free(void) {
+#if ENABLE_HASH
+    if (cache.enabled) {
+        cache_refresh();
+        if (cache.fd != -1)
+            close(cache.fd);
+        free(cache.file);
+        memset(&cache, 0, sizeof(cache));
+        munlock(&cache, sizeof(cache));
+        cache.fd = -1;
+        cache.cost = 16384;
+    }
+#endif
+    if (warm_handle != NULL) {
+        pam_end(warm_handle, PAM_SUCCESS);
+        warm_handle = NULL;
+    }
     free(service);
     service = NULL;
+    free(tty);
+    tty = NULL;
 }
 
 struct aModuleAuth alock_auth_pam = {
@@ -146,4 +559,5 @@ struct aModuleAuth alock_auth_pam = {
         module_free,
     },
     module_authenticate,
+    module_verify,
 };
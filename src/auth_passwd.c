@@ -16,6 +16,7 @@
 
 #include "alock.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <crypt.h>
 #include <unistd.h>
@@ -66,12 +67,35 @@ static int module_init(Display *display) {
 
 static int module_authenticate(const char *pass) {
 
+#if HAVE_CRYPT_R
+    struct crypt_data *data;
+#endif
+    const char *hash;
+    int rv;
+
     if (pass == NULL || pwd_entry == NULL)
         return -1;
 
+#if HAVE_CRYPT_R
+    /* Use the reentrant variant, because the speculative verification and
+     * chained modules might call us from different threads. */
+    if ((data = calloc(1, sizeof(*data))) == NULL)
+        return -1;
+    hash = crypt_r(pass, pwd_entry->pw_passwd, data);
+#else
+    hash = crypt(pass, pwd_entry->pw_passwd);
+#endif
+
     /* Simpler, and should work with crypt() algorithms using longer
      * salt strings (like the md5-based one on freebsd).  --marekm */
-    return strcmp(crypt(pass, pwd_entry->pw_passwd), pwd_entry->pw_passwd);
+    rv = hash != NULL ? strcmp(hash, pwd_entry->pw_passwd) : -1;
+
+#if HAVE_CRYPT_R
+    memset(data, 0, sizeof(*data));
+    free(data);
+#endif
+
+    return rv;
 }
 
 
@@ -83,4 +107,10 @@ struct aModuleAuth alock_auth_passwd = {
         module_dummy_free,
     },
     module_authenticate,
+#if HAVE_CRYPT_R
+    module_authenticate,
+#else
+    /* crypt() is not reentrant */
+    NULL,
+#endif
 };
@@ -0,0 +1,379 @@
+/*
+ * alock - bench.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * Authentication modules micro-benchmark. Every tested module is initialized
+ * and then its authenticate() callback is called repeatedly with the correct
+ * and with the wrong password. For every case the throughput and the latency
+ * percentiles are reported.
+ *
+ * Usage:
+ *  alock-bench [-n <count>] [-t <seconds>] [-p <password>] [-auth type:options ...]
+ *
+ * When no -auth option is given, all compiled in modules are tested with the
+ * reference data generated on the fly. The passwd module is given the entry
+ * with the reference hash by the getpwuid() defined below. The PAM module is
+ * tested against the local "alock-bench" service with the stub module from
+ * the pam_alock_bench.c file (if the PAM library supports custom service
+ * directories), or against the "alock-bench" service from /etc/pam.d/.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include "alock.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if ENABLE_PASSWD
+# include <crypt.h>
+# include <pwd.h>
+#endif
+#if ENABLE_PAM
+# include <security/pam_appl.h>
+#endif
+#if ENABLE_HASH
+# include <gcrypt.h>
+#endif
+
+
+static struct aModuleAuth *bench_modules_auth[] = {
+#if ENABLE_PAM
+    &alock_auth_pam,
+#endif
+#if ENABLE_PASSWD
+    &alock_auth_passwd,
+#endif
+#if ENABLE_HASH
+    &alock_auth_hash,
+#endif
+    &alock_auth_none,
+    NULL
+};
+
+static struct benchConfig {
+    unsigned int count;
+    double time_limit;
+    const char *password;
+    const char *wrong;
+} config = { 1000, 1.0, "alock-bench", "wrong-bench" };
+
+#if ENABLE_PASSWD
+/* password entry with the reference hash used by the crypt() benchmark */
+static struct passwd *crypt_reference = NULL;
+#endif
+
+#if ENABLE_PAM && HAVE_PAM_START_CONFDIR
+/* directory with the stub "alock-bench" service */
+static const char *pam_confdir = NULL;
+#endif
+
+
+#if ENABLE_PASSWD
+/* The passwd module authenticates the current user. In order to benchmark
+ * it with the generated reference hash, its getpwuid() call is resolved to
+ * this function, which returns the reference entry when it is set. The user
+ * name of such an entry does not exist, so the module will not replace the
+ * hash with the one from the shadow file. */
+struct passwd *getpwuid(uid_t uid) {
+
+    static struct passwd pwd;
+    static char buffer[4096];
+    struct passwd *result = NULL;
+    int err;
+
+    if (crypt_reference != NULL)
+        return crypt_reference;
+
+    if ((err = getpwuid_r(uid, &pwd, buffer, sizeof(buffer), &result)) != 0)
+        errno = err;
+    return result;
+}
+#endif
+
+#if ENABLE_PAM && HAVE_PAM_START_CONFDIR
+/* Start PAM transaction with the service from the stub directory, if set.
+ * This function takes precedence over the one from the PAM library, so the
+ * PAM module can be benchmarked without the system-wide configuration. */
+int pam_start(const char *service_name, const char *user,
+        const struct pam_conv *pam_conversation, pam_handle_t **pamh) {
+    return pam_start_confdir(service_name, user, pam_conversation, pam_confdir, pamh);
+}
+#endif
+
+
+/* Get monotonic time-stamp in nanoseconds. */
+static double bench_ntime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Call given authentication function until the requested number of calls
+ * is reached or the time limit is exceeded, and print statistics. */
+static void bench_run(const char *label, int (*authenticate)(const char *pass),
+        const char *pass, int expected) {
+
+    double *samples = malloc(sizeof(*samples) * config.count);
+    double start = bench_ntime();
+    double total = 0;
+    unsigned int i, errors = 0;
+
+    for (i = 0; i < config.count; i++) {
+        double t0 = bench_ntime();
+        int rv = authenticate(pass);
+        samples[i] = bench_ntime() - t0;
+        if ((rv == 0) != (expected == 0))
+            errors++;
+        if (bench_ntime() - start > config.time_limit * 1e9) {
+            i++;
+            break;
+        }
+    }
+
+    qsort(samples, i, sizeof(*samples), cmp_double);
+    total = bench_ntime() - start;
+
+    printf("%-28s %-7s %8u %12.1f %12.1f %12.1f %s\n", label,
+            expected == 0 ? "correct" : "wrong", i, i / (total / 1e9),
+            samples[i * 50 / 100] / 1e3, samples[i * 99 / 100] / 1e3,
+            errors ? "UNEXPECTED RESULT" : "");
+
+    free(samples);
+}
+
+/* Benchmark authentication module initialized with given arguments. */
+static void bench_module(const char *label, const char *args) {
+
+    struct aModuleAuth **i;
+
+    for (i = bench_modules_auth; *i; ++i)
+        if (strstr(args, (*i)->m.name) == args)
+            break;
+
+    if (*i == NULL) {
+        fprintf(stderr, "alock-bench: authentication module `%s` not found\n", args);
+        return;
+    }
+
+    (*i)->m.loadargs(args);
+    if ((*i)->m.init(NULL) != 0) {
+        fprintf(stderr, "alock-bench: skipping [%s]: init failed\n", label);
+        (*i)->m.free();
+        return;
+    }
+
+    bench_run(label, (*i)->authenticate, config.password, 0);
+    /* the none module accepts everything */
+    if (*i != &alock_auth_none)
+        bench_run(label, (*i)->authenticate, config.wrong, 1);
+    (*i)->m.free();
+
+}
+
+#if ENABLE_HASH
+/* Benchmark hash module with given algorithm or KDF. */
+static void bench_hash(const char *label, const char *options, int kdf, int algo,
+        unsigned long iterations) {
+
+    static const unsigned char salt[16] = "alock-bench-salt";
+    unsigned char digest[64];
+    char args[512];
+    int len = 32;
+    int i, n;
+
+    if (kdf == 0) {
+        if (gcry_md_test_algo(algo) != 0)
+            return;
+        len = gcry_md_get_algo_dlen(algo);
+        gcry_md_hash_buffer(algo, digest, config.password, strlen(config.password));
+    }
+    else if (gcry_kdf_derive(config.password, strlen(config.password), kdf, algo,
+                salt, sizeof(salt), iterations, len, digest) != 0)
+        return;
+
+    n = snprintf(args, sizeof(args), "hash:%s,", options);
+    if (kdf != 0) {
+        n += snprintf(&args[n], sizeof(args) - n, "salt=");
+        for (i = 0; i < (int)sizeof(salt); i++)
+            n += snprintf(&args[n], sizeof(args) - n, "%02x", salt[i]);
+        n += snprintf(&args[n], sizeof(args) - n, ",");
+    }
+    n += snprintf(&args[n], sizeof(args) - n, "hash=");
+    for (i = 0; i < len; i++)
+        n += snprintf(&args[n], sizeof(args) - n, "%02x", digest[i]);
+
+    bench_module(label, args);
+}
+#endif
+
+#if ENABLE_PASSWD
+/* Benchmark passwd module with crypt() hash of the given scheme. */
+static void bench_crypt(const char *label, const char *prefix) {
+
+    static struct passwd pwd = { .pw_name = "alock-bench" };
+    const char *salt = prefix;
+    char *hash;
+
+#if CRYPT_GENSALT_IMPLEMENTS_AUTO_ENTROPY
+    /* generate salt in the format required by the scheme */
+    if (prefix[0] == '$' && (salt = crypt_gensalt(prefix, 0, NULL, 0)) == NULL)
+        return;
+#endif
+
+    if ((hash = crypt(config.password, salt)) == NULL || hash[0] == '*') {
+        fprintf(stderr, "alock-bench: skipping [%s]: scheme not supported\n", label);
+        return;
+    }
+
+    pwd.pw_passwd = strdup(hash);
+    pwd.pw_uid = getuid();
+    crypt_reference = &pwd;
+    bench_module(label, "passwd");
+    crypt_reference = NULL;
+    free(pwd.pw_passwd);
+
+}
+#endif
+
+#if ENABLE_PAM
+/* Benchmark PAM module with the stub service. */
+static void bench_pam(void) {
+
+#if HAVE_PAM_START_CONFDIR
+    char confdir[] = "/tmp/alock-bench.XXXXXX";
+    char service[sizeof(confdir) + 16];
+    FILE *f;
+
+    if (access(ALOCK_BENCH_PAM_MODULE, R_OK) == 0 && mkdtemp(confdir) != NULL) {
+
+        snprintf(service, sizeof(service), "%s/alock-bench", confdir);
+        if ((f = fopen(service, "w")) != NULL) {
+            fprintf(f, "auth required %s password=%s\n",
+                    ALOCK_BENCH_PAM_MODULE, config.password);
+            fclose(f);
+
+            pam_confdir = confdir;
+            bench_module("pam[stub]", "pam:service=alock-bench");
+            bench_module("pam[stub,warm]", "pam:service=alock-bench,warm");
+            pam_confdir = NULL;
+
+            unlink(service);
+        }
+
+        rmdir(confdir);
+        return;
+    }
+#endif
+
+    if (access("/etc/pam.d/alock-bench", R_OK) == 0) {
+        bench_module("pam[alock-bench]", "pam:service=alock-bench");
+        bench_module("pam[alock-bench,warm]", "pam:service=alock-bench,warm");
+    }
+    else
+        fprintf(stderr, "alock-bench: skipping [pam]: alock-bench service not configured\n");
+
+}
+#endif
+
+/* Run all compiled in modules with generated reference data. */
+static void bench_defaults(void) {
+
+    bench_module("none", "none");
+
+#if ENABLE_HASH
+    gcry_check_version(NULL);
+    bench_hash("hash[md5]", "type=md5", 0, GCRY_MD_MD5, 0);
+    bench_hash("hash[sha1]", "type=sha1", 0, GCRY_MD_SHA1, 0);
+    bench_hash("hash[sha256]", "type=sha256", 0, GCRY_MD_SHA256, 0);
+    bench_hash("hash[sha384]", "type=sha384", 0, GCRY_MD_SHA384, 0);
+    bench_hash("hash[sha512]", "type=sha512", 0, GCRY_MD_SHA512, 0);
+    bench_hash("hash[whirlpool]", "type=whirlpool", 0, GCRY_MD_WHIRLPOOL, 0);
+    bench_hash("hash[pbkdf2-sha256]", "kdf=pbkdf2,type=sha256,iter=10000",
+            GCRY_KDF_PBKDF2, GCRY_MD_SHA256, 10000);
+    bench_hash("hash[scrypt]", "kdf=scrypt,cost=4096,par=1",
+            GCRY_KDF_SCRYPT, 4096, 1);
+#endif
+
+#if ENABLE_PASSWD
+    bench_crypt("passwd[des]", "ab");
+    bench_crypt("passwd[md5]", "$1$");
+    bench_crypt("passwd[sha256]", "$5$");
+    bench_crypt("passwd[sha512]", "$6$");
+    bench_crypt("passwd[bcrypt]", "$2b$");
+    bench_crypt("passwd[yescrypt]", "$y$");
+    /* module itself against the current user entry, if readable */
+    bench_module("passwd[user]", "passwd");
+#endif
+
+#if ENABLE_PAM
+    bench_pam();
+#endif
+
+}
+
+int main(int argc, char **argv) {
+
+    int opt;
+    struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"count", required_argument, NULL, 'n'},
+        {"time", required_argument, NULL, 't'},
+        {"password", required_argument, NULL, 'p'},
+        {"auth", required_argument, NULL, 'a'},
+        {0, 0, 0, 0},
+    };
+
+    const char *args[32];
+    unsigned int args_count = 0;
+    unsigned int i;
+
+    while ((opt = getopt_long_only(argc, argv, "hn:t:p:a:", longopts, NULL)) != -1)
+        switch (opt) {
+        case 'h':
+            printf("%s [-help] [-count N] [-time seconds] [-password pass]"
+                    " [-auth type:options ...]\n", argv[0]);
+            return EXIT_SUCCESS;
+        case 'n':
+            if ((config.count = strtoul(optarg, NULL, 0)) == 0)
+                config.count = 1;
+            break;
+        case 't':
+            config.time_limit = strtod(optarg, NULL);
+            break;
+        case 'p':
+            config.password = optarg;
+            break;
+        case 'a':
+            if (args_count < sizeof(args) / sizeof(*args))
+                args[args_count++] = optarg;
+            break;
+        default:
+            fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+
+    printf("%-28s %-7s %8s %12s %12s %12s\n", "module", "pass",
+            "calls", "calls/s", "p50 [us]", "p99 [us]");
+
+    if (args_count == 0)
+        bench_defaults();
+    for (i = 0; i < args_count; i++)
+        bench_module(args[i], args[i]);
+
+    return EXIT_SUCCESS;
+}
@@ -59,35 +59,38 @@ static void module_loadxrdb(XrmDatabase xrdb) {
 
 }
 
-static int module_init(Display *dpy) {
-
-    int i;
+/* Create background window for the given screen. This function is called
+ * concurrently for all screens, so it shall not modify shared data. */
+static int init_screen(unsigned int i, void *arg) {
+    (void)arg;
 
-    data.display = dpy;
-    data.windows = (Window *)malloc(sizeof(Window) * ScreenCount(dpy));
+    Display *dpy = data.display;
+    Screen *screen = ScreenOfDisplay(dpy, i);
+    Colormap colormap = DefaultColormapOfScreen(screen);
+    XSetWindowAttributes xswa;
+    XColor color;
 
-    for (i = 0; i < ScreenCount(dpy); i++) {
+    alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
 
-        Screen *screen = ScreenOfDisplay(dpy, i);
-        Colormap colormap = DefaultColormapOfScreen(screen);
-        XSetWindowAttributes xswa;
-        XColor color;
+    xswa.override_redirect = True;
+    xswa.colormap = colormap;
+    xswa.background_pixel = color.pixel;
 
-        alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
+    data.windows[i] = XCreateWindow(dpy, RootWindowOfScreen(screen),
+            0, 0, WidthOfScreen(screen), HeightOfScreen(screen), 0,
+            CopyFromParent, InputOutput, CopyFromParent,
+            CWOverrideRedirect | CWColormap | CWBackPixel,
+            &xswa);
 
-        xswa.override_redirect = True;
-        xswa.colormap = colormap;
-        xswa.background_pixel = color.pixel;
+    return 0;
+}
 
-        data.windows[i] = XCreateWindow(dpy, RootWindowOfScreen(screen),
-                0, 0, WidthOfScreen(screen), HeightOfScreen(screen), 0,
-                CopyFromParent, InputOutput, CopyFromParent,
-                CWOverrideRedirect | CWColormap | CWBackPixel,
-                &xswa);
+static int module_init(Display *dpy) {
 
-    }
+    data.display = dpy;
+    data.windows = (Window *)malloc(sizeof(Window) * ScreenCount(dpy));
 
-    return 0;
+    return alock_parallel(ScreenCount(dpy), init_screen, NULL);
 }
 
 static void module_free() {
@@ -120,4 +123,5 @@ struct aModuleBackground alock_bg_blank = {
         module_free,
     },
     module_getwindow,
+    NULL,
 };
@@ -8,20 +8,51 @@
  * This project is licensed under the terms of the MIT license.
  *
  * This background module provides:
- *  -bg image:file=<file>,color=<color>,shade=<int>,scale,center,tiled
+ *  -bg image:file=<file>,file[<output>]=<file>,color=<color>,shade=<int>,
+ *            scale,zoom,fit,center,tiled,filter=<bilinear|lanczos>
  *
  * Used resources:
  *  ALock.Background.Image.Color
  *  ALock.Background.Image.Shade
  *  ALock.Background.Image.Option
+ *  ALock.Background.Image.Filter
+ *
+ * Image is decoded once (see image.c for the list of supported formats) and
+ * kept in memory for the screen reconfiguration. When alock is built with
+ * the threads support, decoding is started in a worker thread as soon as the
+ * file name is known, so it overlaps with the X connection setup. Note, that
+ * alock might still run with elevated privileges at that time, so the file
+ * is opened upfront with the rights of the real user, and only the built-in
+ * decoders are used. Other formats are loaded during the initialization.
+ *
+ * With the RandR support, every output might have its own image. Decoded and
+ * scaled images are cached by the file name and size, so the same file used
+ * on many outputs (or screens) of the same resolution is processed once.
+ *
+ * Upon the screen reconfiguration, only areas whose geometry has changed are
+ * rendered once again, the rest is copied from the previous pixmap. With the
+ * threads support, this is done in a worker thread, so the event loop is not
+ * blocked by the image scaling.
  *
  */
 
 #include "alock.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <Imlib2.h>
+#include <unistd.h>
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
+#if HAVE_XRANDR
+# include <X11/extensions/Xrandr.h>
+#endif
+
+/* maximal number of per-output images */
+#define IMAGE_OUTPUTS_MAX 8
+/* maximal number of cached images (decoded and scaled) */
+#define IMAGE_CACHE_MAX 16
 
 
 enum aImageOption {
@@ -29,17 +60,162 @@ enum aImageOption {
     AIMAGE_OPTION_SCALE,
     AIMAGE_OPTION_CENTER,
     AIMAGE_OPTION_TILED,
+    /* scale preserving the aspect ratio - cover the whole screen */
+    AIMAGE_OPTION_ZOOM,
+    /* scale preserving the aspect ratio - fit into the screen */
+    AIMAGE_OPTION_FIT,
+};
+
+/* image placed on the part of the screen */
+struct imageArea {
+    const char *filename;
+    int x, y;
+    int width, height;
+};
+
+/* background state of the screen */
+struct imageScreen {
+    /* areas rendered into the screen pixmap */
+    struct imageArea *areas;
+    unsigned int count;
+    /* geometry requested by the last resize */
+    int width;
+    int height;
+    /* incremented upon every resize request */
+    unsigned int generation;
+    /* generation of the current pixmap */
+    unsigned int rendered;
+};
+
+struct imageCacheEntry {
+    char *filename;
+    /* size of the scaled image, or zero for the decoded one */
+    unsigned int width;
+    unsigned int height;
+    struct aImage image;
 };
 
 static struct moduleData {
     Display *display;
+    /* target of the background decoding */
+    struct aImage image;
     Pixmap *pixmaps;
     Window *windows;
+    struct imageScreen *screens;
     char *colorname;
     char *filename;
+    /* images for the RandR outputs */
+    struct {
+        char *output;
+        char *filename;
+    } outputs[IMAGE_OUTPUTS_MAX];
+    unsigned int outputs_count;
+    struct imageCacheEntry cache[IMAGE_CACHE_MAX];
+    /* next entry replaced when the cache is full */
+    unsigned int cache_next;
     unsigned int shade;
     enum aImageOption option;
-} data = { 0 };
+    enum aImageFilter filter;
+#if ENABLE_THREADS
+    /* image decoding in the background */
+    struct {
+        pthread_t thread;
+        char *filename;
+        int fd;
+        int started;
+        int status;
+    } prefetch;
+    /* screen rendering in the background */
+    struct {
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        int started;
+        int running;
+        int cancel;
+    } resize;
+#endif
+} data = {
+#if ENABLE_THREADS
+    .resize.mutex = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    .filter = AIMAGE_FILTER_LANCZOS3,
+};
+
+
+#if ENABLE_THREADS
+
+static void *prefetch_worker(void *arg) {
+    (void)arg;
+
+    int trace;
+
+    trace = alock_trace_begin("image.prefetch", "image");
+    data.prefetch.status = alock_image_decode(&data.image, data.prefetch.fd);
+    alock_trace_end(trace);
+
+    close(data.prefetch.fd);
+
+    return NULL;
+}
+
+/* Start decoding of the image file in the background. The decoded image is
+ * stored in the module data, so it must not be accessed until the worker
+ * is joined with the prefetch_wait(). */
+static void prefetch_start(void) {
+
+    if (data.prefetch.started)
+        return;
+
+    /* errors are reported by the regular loading */
+    if ((data.prefetch.fd = alock_open_user(data.filename, O_RDONLY, 0)) == -1)
+        return;
+
+    if ((data.prefetch.filename = strdup(data.filename)) == NULL) {
+        close(data.prefetch.fd);
+        return;
+    }
+
+    if (pthread_create(&data.prefetch.thread, NULL, prefetch_worker, NULL) != 0) {
+        close(data.prefetch.fd);
+        free(data.prefetch.filename);
+        data.prefetch.filename = NULL;
+        return;
+    }
+
+    data.prefetch.started = 1;
+}
+
+/* Wait for the background decoding. This function returns 0 if the image of
+ * the current file has been decoded successfully, otherwise -1. */
+static int prefetch_wait(void) {
+
+    int trace;
+    int rv = -1;
+
+    if (!data.prefetch.started)
+        return -1;
+
+    trace = alock_trace_begin("image.prefetch.wait", "image");
+    pthread_join(data.prefetch.thread, NULL);
+    alock_trace_end(trace);
+
+    data.prefetch.started = 0;
+
+    if (data.prefetch.status == 0) {
+        /* file name might have been changed in the meantime */
+        if (data.filename && strcmp(data.prefetch.filename, data.filename) == 0)
+            rv = 0;
+        else
+            alock_image_free(&data.image);
+    }
+
+    free(data.prefetch.filename);
+    data.prefetch.filename = NULL;
+
+    return rv;
+}
+
+#endif /* ENABLE_THREADS */
 
 
 static void module_loadargs(const char *args) {
@@ -57,6 +233,30 @@ static void module_loadargs(const char *args) {
             free(data.filename);
             data.filename = strdup(&arg[5]);
         }
+        else if (strstr(arg, "file[") == arg) {
+            char *output = &arg[5];
+            char *end = strstr(output, "]=");
+            unsigned int i;
+            if (end == NULL || end == output) {
+                fprintf(stderr, "[image]: invalid per-output file: %s\n", arg);
+                continue;
+            }
+            *end = '\0';
+            for (i = 0; i < data.outputs_count; i++)
+                if (strcmp(data.outputs[i].output, output) == 0)
+                    break;
+            if (i == IMAGE_OUTPUTS_MAX) {
+                fprintf(stderr, "[image]: too many per-output files\n");
+                continue;
+            }
+            if (i == data.outputs_count) {
+                data.outputs[i].output = strdup(output);
+                data.outputs_count++;
+            }
+            else
+                free(data.outputs[i].filename);
+            data.outputs[i].filename = strdup(&end[2]);
+        }
         else if (strcmp(arg, "scale") == 0) {
             data.option = AIMAGE_OPTION_SCALE;
         }
@@ -66,6 +266,18 @@ static void module_loadargs(const char *args) {
         else if (strcmp(arg, "tiled") == 0) {
             data.option = AIMAGE_OPTION_TILED;
         }
+        else if (strcmp(arg, "zoom") == 0) {
+            data.option = AIMAGE_OPTION_ZOOM;
+        }
+        else if (strcmp(arg, "fit") == 0) {
+            data.option = AIMAGE_OPTION_FIT;
+        }
+        else if (strcmp(arg, "filter=bilinear") == 0) {
+            data.filter = AIMAGE_FILTER_BILINEAR;
+        }
+        else if (strcmp(arg, "filter=lanczos") == 0) {
+            data.filter = AIMAGE_FILTER_LANCZOS3;
+        }
         else if (strstr(arg, "color=") == arg) {
             free(data.colorname);
             data.colorname = strdup(&arg[6]);
@@ -78,6 +290,11 @@ static void module_loadargs(const char *args) {
     }
 
     free(arguments);
+
+#if ENABLE_THREADS
+    if (data.filename)
+        prefetch_start();
+#endif
 }
 
 static void module_loadxrdb(XrmDatabase xrdb) {
@@ -93,6 +310,18 @@ static void module_loadxrdb(XrmDatabase xrdb) {
             data.option = AIMAGE_OPTION_CENTER;
         else if (strcmp(value.addr, "tiled") == 0)
             data.option = AIMAGE_OPTION_TILED;
+        else if (strcmp(value.addr, "zoom") == 0)
+            data.option = AIMAGE_OPTION_ZOOM;
+        else if (strcmp(value.addr, "fit") == 0)
+            data.option = AIMAGE_OPTION_FIT;
+    }
+
+    if (XrmGetResource(xrdb, "alock.background.image.filter",
+                "ALock.Background.Image.Filter", &type, &value)) {
+        if (strcmp(value.addr, "bilinear") == 0)
+            data.filter = AIMAGE_FILTER_BILINEAR;
+        else if (strcmp(value.addr, "lanczos") == 0)
+            data.filter = AIMAGE_FILTER_LANCZOS3;
     }
 
     if (XrmGetResource(xrdb, "alock.background.image.color",
@@ -105,167 +334,556 @@ static void module_loadxrdb(XrmDatabase xrdb) {
 
 }
 
-static int module_init(Display *dpy) {
+/* Get the size of the image placed on the area of the given size. */
+static void placed_size(const struct aImage *image, int rwidth, int rheight,
+        unsigned int *width, unsigned int *height) {
 
-    if (!data.filename) {
-        fprintf(stderr, "[image]: file name not specified\n");
-        return -1;
+    double fx = (double)rwidth / image->width;
+    double fy = (double)rheight / image->height;
+    double f;
+
+    switch (data.option) {
+    case AIMAGE_OPTION_CENTER:
+    case AIMAGE_OPTION_TILED:
+        *width = image->width;
+        *height = image->height;
+        return;
+    case AIMAGE_OPTION_ZOOM:
+        f = fx > fy ? fx : fy;
+        break;
+    case AIMAGE_OPTION_FIT:
+        f = fx < fy ? fx : fy;
+        break;
+    default: /* fallback is AIMAGE_OPTION_SCALE */
+        *width = rwidth;
+        *height = rheight;
+        return;
     }
 
-    if (!alock_check_xrender(dpy))
-        data.shade = 0;
+    /* one of the dimensions matches the screen exactly */
+    *width = f == fx ? (unsigned int)rwidth : image->width * f + 0.5;
+    *height = f == fy ? (unsigned int)rheight : image->height * f + 0.5;
+    if (*width == 0)
+        *width = 1;
+    if (*height == 0)
+        *height = 1;
 
-    data.display = dpy;
-    data.windows = (Window *)malloc(sizeof(Window) * ScreenCount(dpy));
-    data.pixmaps = (Pixmap *)malloc(sizeof(Pixmap) * ScreenCount(dpy));
+}
+
+/* Store given image in the cache. The ownership of the image data is taken
+ * over by the cache. */
+static const struct aImage *cache_insert(const char *filename,
+        unsigned int width, unsigned int height, struct aImage *image) {
+
+    struct imageCacheEntry *e;
+    unsigned int i;
+
+    /* Find a free entry. When the cache is full, scaled images are replaced
+     * in the round-robin fashion, but decoded ones are kept. */
+    for (i = 0; i < IMAGE_CACHE_MAX; i++)
+        if (data.cache[i].filename == NULL)
+            break;
+    if (i == IMAGE_CACHE_MAX) {
+        for (i = 0; i < IMAGE_CACHE_MAX; i++) {
+            e = &data.cache[data.cache_next];
+            data.cache_next = (data.cache_next + 1) % IMAGE_CACHE_MAX;
+            if (e->width != 0)
+                break;
+        }
+        if (i == IMAGE_CACHE_MAX) {
+            /* NOTE: This can not happen, because there are more entries than
+             *       the number of files. */
+            alock_image_free(image);
+            return NULL;
+        }
+        free(e->filename);
+        alock_image_free(&e->image);
+    }
+    else
+        e = &data.cache[i];
 
-    {
-        XSetWindowAttributes xswa;
-        XColor color;
-        int i;
+    e->filename = strdup(filename);
+    e->width = width;
+    e->height = height;
+    e->image = *image;
 
-        for (i = 0; i < ScreenCount(dpy); i++) {
+    debug("cached image: %s (%ux%u)", filename, image->width, image->height);
+    return &e->image;
+}
 
-            Screen *screen = ScreenOfDisplay(dpy, i);
-            Colormap colormap = DefaultColormapOfScreen(screen);
-            Window root = RootWindowOfScreen(screen);
-            const int depth = DefaultDepthOfScreen(screen);
-            const int rwidth = WidthOfScreen(screen);
-            const int rheight = HeightOfScreen(screen);
-            alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
+/* Get cached image of the given file. If the size is not zero, the decoded
+ * image is scaled to that size. On error this function returns NULL. */
+static const struct aImage *cache_get(const char *filename,
+        unsigned int width, unsigned int height) {
+
+    const struct aImage *decoded;
+    const struct imageCacheEntry *e;
+    struct aImage image;
+    unsigned int i;
+    int trace;
+    int rv;
+
+    for (i = 0; i < IMAGE_CACHE_MAX; i++) {
+        e = &data.cache[i];
+        if (e->filename != NULL && e->width == width && e->height == height &&
+                strcmp(e->filename, filename) == 0)
+            return &e->image;
+    }
 
-            { /* get image and set it as the background pixmap for the window */
-                Imlib_Context context = NULL;
-                Imlib_Image image = NULL;
+    if (width == 0) {
+        trace = alock_trace_begin("image.load", "image");
+        rv = alock_image_load(&image, filename);
+        alock_trace_end(trace);
+        if (rv != 0) {
+            fprintf(stderr, "[image]: unable to load image from file: %s\n", filename);
+            return NULL;
+        }
+    }
+    else {
+        if ((decoded = cache_get(filename, 0, 0)) == NULL)
+            return NULL;
+        if (decoded->width == width && decoded->height == height)
+            return decoded;
+        trace = alock_trace_begin("image.scale", "image");
+        rv = alock_image_scale(&image, decoded, width, height, data.filter);
+        alock_trace_end(trace);
+        if (rv != 0)
+            return decoded;
+    }
 
-                context = imlib_context_new();
-                imlib_context_push(context);
-                imlib_context_set_display(dpy);
-                imlib_context_set_visual(DefaultVisualOfScreen(screen));
-                imlib_context_set_colormap(colormap);
+    return cache_insert(filename, width, height, &image);
+}
 
-                image = imlib_load_image_without_cache(data.filename);
-                if (image) {
+static void cache_free(void) {
+    unsigned int i;
+    for (i = 0; i < IMAGE_CACHE_MAX; i++) {
+        free(data.cache[i].filename);
+        data.cache[i].filename = NULL;
+        alock_image_free(&data.cache[i].image);
+    }
+}
 
-                    int w;
-                    int h;
+#if HAVE_XRANDR
+/* Get the file name configured for the given output. */
+static const char *output_filename(const char *output) {
+    unsigned int i;
+    for (i = 0; i < data.outputs_count; i++)
+        if (strcmp(data.outputs[i].output, output) == 0)
+            return data.outputs[i].filename;
+    return data.filename;
+}
+#endif
 
-                    data.pixmaps[i] = XCreatePixmap(dpy, root, rwidth, rheight, depth);
+/* Split the screen of the given size into areas with images. Without the
+ * per-output files, the whole screen is one area. This function returns
+ * the number of areas, which have to be freed with free(). */
+static unsigned int screen_areas(int i, int rwidth, int rheight, struct imageArea **areas) {
 
-                    imlib_context_set_drawable(data.pixmaps[i]);
-                    imlib_context_set_image(image);
+    struct imageArea *a;
 
-                    w = imlib_image_get_width();
-                    h = imlib_image_get_height();
+#if HAVE_XRANDR
+    if (data.outputs_count > 0) {
 
-                    if (data.shade || data.option == AIMAGE_OPTION_CENTER) {
-                        GC gc;
-                        XGCValues gcval;
+        Display *dpy = data.display;
+        unsigned int count = 0;
+        Window root = RootWindow(dpy, i);
+        XRRScreenResources *res;
+        int event, error, c, o;
 
-                        gcval.foreground = color.pixel;
-                        gc = XCreateGC(dpy, root, GCForeground, &gcval);
-                        XFillRectangle(dpy, data.pixmaps[i], gc, 0, 0, rwidth, rheight);
-                        XFreeGC(dpy, gc);
-                    }
+        if (XRRQueryExtension(dpy, &event, &error) &&
+                (res = XRRGetScreenResourcesCurrent(dpy, root)) != NULL) {
 
-                    if (data.shade) {
-                        GC gc;
-                        XGCValues gcval;
+            *areas = malloc(sizeof(**areas) * (res->ncrtc + 1));
 
-                        Pixmap tmp_pixmap = XCreatePixmap(dpy, root, w, h, depth);
-                        Pixmap shaded_pixmap = XCreatePixmap(dpy, root, w, h, depth);
-                        gcval.foreground = color.pixel;
-                        gc = XCreateGC(dpy, root, GCForeground, &gcval);
-                        XFillRectangle(dpy, shaded_pixmap, gc, 0, 0, w, h);
+            for (c = 0; *areas != NULL && c < res->ncrtc; c++) {
 
-                        imlib_context_set_drawable(tmp_pixmap);
-                        imlib_render_image_on_drawable(0, 0);
+                XRRCrtcInfo *crtc;
+                const char *filename = NULL;
 
-                        Visual *vis = DefaultVisualOfScreen(screen);
-                        alock_shade_pixmap(dpy, vis, tmp_pixmap, shaded_pixmap, data.shade, 0, 0, 0, 0, w, h);
+                if ((crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[c])) == NULL)
+                    continue;
 
-                        imlib_free_image_and_decache();
-                        imlib_context_set_drawable(shaded_pixmap);
+                /* mirrored outputs share the CRTC, use the first match */
+                for (o = 0; crtc->mode != None && o < crtc->noutput && filename == NULL; o++) {
+                    XRROutputInfo *output;
+                    if ((output = XRRGetOutputInfo(dpy, res, crtc->outputs[o])) == NULL)
+                        continue;
+                    filename = output_filename(output->name);
+                    debug("output %s: %ux%u+%d+%d: %s", output->name, crtc->width,
+                            crtc->height, crtc->x, crtc->y, filename);
+                    XRRFreeOutputInfo(output);
+                }
 
-                        image = imlib_create_image_from_drawable(None, 0, 0, w, h, 0);
+                if (filename != NULL) {
+                    a = &(*areas)[count++];
+                    a->filename = filename;
+                    a->x = crtc->x;
+                    a->y = crtc->y;
+                    a->width = crtc->width;
+                    a->height = crtc->height;
+                }
 
-                        XFreePixmap(dpy, shaded_pixmap);
-                        XFreePixmap(dpy, tmp_pixmap);
+                XRRFreeCrtcInfo(crtc);
+            }
 
-                        imlib_context_set_drawable(data.pixmaps[i]);
-                        imlib_context_set_image(image);
-                    }
+            XRRFreeScreenResources(res);
 
-                    if (data.option == AIMAGE_OPTION_CENTER) {
-                        imlib_render_image_on_drawable((rwidth - w)/2, (rheight - h)/2);
-                    }
-                    else if (data.option == AIMAGE_OPTION_TILED) {
-                        Pixmap tile;
-                        GC gc;
-                        XGCValues gcval;
+            if (count > 0)
+                return count;
+            free(*areas);
 
-                        tile = XCreatePixmap(dpy, root, w, h, depth);
+        }
 
-                        imlib_render_image_on_drawable(0, 0);
+    }
+#else
+    (void)i;
+#endif
 
-                        gcval.fill_style = FillTiled;
-                        gcval.tile = tile;
-                        gc = XCreateGC(dpy, tile, GCFillStyle|GCTile, &gcval);
-                        XFillRectangle(dpy, data.pixmaps[i], gc, 0, 0, rwidth, rheight);
+    if (data.filename == NULL ||
+            (*areas = malloc(sizeof(**areas))) == NULL)
+        return 0;
 
-                        XFreeGC(dpy, gc);
-                        XFreePixmap(dpy, tile);
-                    } else { /* fallback is AIMAGE_OPTION_SCALE */
-                        imlib_render_image_on_drawable_at_size(0, 0, rwidth, rheight);
-                    }
-                    imlib_free_image_and_decache();
+    a = *areas;
+    a->filename = data.filename;
+    a->x = a->y = 0;
+    a->width = rwidth;
+    a->height = rheight;
 
-                }
-                else {
-                    fprintf(stderr, "[image]: unable to load image from file\n");
-                    free(data.windows);
-                    free(data.pixmaps);
-                    data.windows = NULL;
-                    data.pixmaps = NULL;
-                    return -1;
-                }
+    return 1;
+}
 
-                imlib_context_pop();
-                imlib_context_free(context);
-            }
+/* Render image of the given area into the screen pixmap. */
+static void render_area(int i, Pixmap pixmap, GC gc, const struct imageArea *area) {
+
+    Display *dpy = data.display;
+    Screen *screen = ScreenOfDisplay(dpy, i);
+    Visual *visual = DefaultVisualOfScreen(screen);
+    Window root = RootWindowOfScreen(screen);
+    const int depth = DefaultDepthOfScreen(screen);
+    const struct aImage *image;
+    XRectangle clip = { area->x, area->y, area->width, area->height };
+    Pixmap source;
+    unsigned int sw;
+    unsigned int sh;
+    int w;
+    int h;
+
+    if ((image = cache_get(area->filename, 0, 0)) == NULL)
+        return;
+
+    placed_size(image, area->width, area->height, &sw, &sh);
+    if ((image = cache_get(area->filename, sw, sh)) == NULL)
+        return;
 
-            xswa.override_redirect = True;
-            xswa.colormap = colormap;
-            xswa.background_pixmap = data.pixmaps[i];
+    w = image->width;
+    h = image->height;
 
-            data.windows[i] = XCreateWindow(dpy, root,
-                    0, 0, rwidth, rheight, 0,
-                    CopyFromParent, InputOutput, CopyFromParent,
-                    CWOverrideRedirect | CWColormap | CWBackPixmap,
-                    &xswa);
+    if ((source = alock_image_pixmap(dpy, root, visual, depth, image)) == None)
+        return;
+
+    if (data.shade) {
+        Pixmap shaded = XCreatePixmap(dpy, root, w, h, depth);
+        XFillRectangle(dpy, shaded, gc, 0, 0, w, h);
+        alock_shade_pixmap(dpy, visual, source, shaded, data.shade, 0, 0, 0, 0, w, h);
+        XFreePixmap(dpy, source);
+        source = shaded;
+    }
+
+    /* image must not exceed its area */
+    XSetClipRectangles(dpy, gc, 0, 0, &clip, 1, Unsorted);
+
+    if (data.option == AIMAGE_OPTION_TILED) {
+        XSetTile(dpy, gc, source);
+        XSetTSOrigin(dpy, gc, area->x, area->y);
+        XSetFillStyle(dpy, gc, FillTiled);
+        XFillRectangle(dpy, pixmap, gc, area->x, area->y, area->width, area->height);
+        XSetFillStyle(dpy, gc, FillSolid);
+    }
+    else /* image is centered, the excess (if any) is cut off */
+        XCopyArea(dpy, source, pixmap, gc, 0, 0, w, h,
+                area->x + (area->width - w) / 2, area->y + (area->height - h) / 2);
 
-            XMapWindow(dpy, data.windows[i]);
+    XSetClipMask(dpy, gc, None);
+    XFreePixmap(dpy, source);
+}
+
+/* Check whether the area is present in the current pixmap of the screen. */
+static int area_rendered(int i, const struct imageArea *area) {
+    const struct imageScreen *s = &data.screens[i];
+    unsigned int n;
+    for (n = 0; n < s->count; n++)
+        if (s->areas[n].x == area->x && s->areas[n].y == area->y &&
+                s->areas[n].width == area->width && s->areas[n].height == area->height &&
+                strcmp(s->areas[n].filename, area->filename) == 0)
+            return 1;
+    return 0;
+}
 
+/* Render images into the new pixmap of the given size. Areas which have not
+ * changed are copied from the current pixmap of the screen. Rendered areas
+ * are returned via the areas argument and have to be freed with free(). */
+static Pixmap render_pixmap(int i, int rwidth, int rheight,
+        struct imageArea **areas, unsigned int *count) {
+
+    Display *dpy = data.display;
+    Screen *screen = ScreenOfDisplay(dpy, i);
+    Colormap colormap = DefaultColormapOfScreen(screen);
+    Window root = RootWindowOfScreen(screen);
+    const int depth = DefaultDepthOfScreen(screen);
+    const struct imageArea *a;
+    unsigned int n;
+    Pixmap pixmap;
+    XGCValues gcval;
+    XColor color;
+    GC gc;
+
+    alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
+
+    pixmap = XCreatePixmap(dpy, root, rwidth, rheight, depth);
+
+    gcval.foreground = color.pixel;
+    gc = XCreateGC(dpy, root, GCForeground, &gcval);
+
+    /* NOTE: Screen is filled with the color beforehand, because the image
+     *       might not cover it entirely (e.g. centered or not loaded). */
+    XFillRectangle(dpy, pixmap, gc, 0, 0, rwidth, rheight);
+
+    *areas = NULL;
+    *count = screen_areas(i, rwidth, rheight, areas);
+    for (n = 0; n < *count; n++) {
+        a = &(*areas)[n];
+        if (area_rendered(i, a)) {
+            debug("area %dx%d+%d+%d not changed", a->width, a->height, a->x, a->y);
+            XCopyArea(dpy, data.pixmaps[i], pixmap, gc, a->x, a->y,
+                    a->width, a->height, a->x, a->y);
         }
+        else
+            render_area(i, pixmap, gc, a);
     }
 
+    XFreeGC(dpy, gc);
+    return pixmap;
+}
+
+/* Replace the pixmap of the given screen with the new one. */
+static void swap_pixmap(int i, Pixmap pixmap, struct imageArea *areas, unsigned int count) {
+
+    Display *dpy = data.display;
+
+    XSetWindowBackgroundPixmap(dpy, data.windows[i], pixmap);
+    XClearWindow(dpy, data.windows[i]);
+    XFreePixmap(dpy, data.pixmaps[i]);
+    data.pixmaps[i] = pixmap;
+
+    free(data.screens[i].areas);
+    data.screens[i].areas = areas;
+    data.screens[i].count = count;
+
+}
+
+/* Render given image into the background window of the given screen. */
+static void render_screen(int i) {
+
+    Display *dpy = data.display;
+    Screen *screen = ScreenOfDisplay(dpy, i);
+    const int rwidth = WidthOfScreen(screen);
+    const int rheight = HeightOfScreen(screen);
+    struct imageScreen *s = &data.screens[i];
+    XSetWindowAttributes xswa;
+
+    data.pixmaps[i] = render_pixmap(i, rwidth, rheight, &s->areas, &s->count);
+
+    xswa.override_redirect = True;
+    xswa.colormap = DefaultColormapOfScreen(screen);
+    xswa.background_pixmap = data.pixmaps[i];
+
+    data.windows[i] = XCreateWindow(dpy, RootWindowOfScreen(screen),
+            0, 0, rwidth, rheight, 0,
+            CopyFromParent, InputOutput, CopyFromParent,
+            CWOverrideRedirect | CWColormap | CWBackPixmap,
+            &xswa);
+
+    XMapWindow(dpy, data.windows[i]);
+
+}
+
+#if ENABLE_THREADS
+
+/* Render screens which have been resized. The worker runs until there is no
+ * pending request. Note, that Xlib is initialized for the threads usage. */
+static void *resize_worker(void *arg) {
+    (void)arg;
+
+    Display *dpy = data.display;
+    struct imageArea *areas;
+    unsigned int generation;
+    unsigned int count;
+    Pixmap pixmap;
+    int width, height;
+    int trace;
+    int i;
+
+    pthread_mutex_lock(&data.resize.mutex);
+
+    while (!data.resize.cancel) {
+
+        for (i = 0; i < ScreenCount(dpy); i++)
+            if (data.screens[i].rendered != data.screens[i].generation)
+                break;
+        if (i == ScreenCount(dpy))
+            break;
+
+        generation = data.screens[i].generation;
+        width = data.screens[i].width;
+        height = data.screens[i].height;
+
+        pthread_mutex_unlock(&data.resize.mutex);
+
+        trace = alock_trace_begin("image.resize", "image");
+        pixmap = render_pixmap(i, width, height, &areas, &count);
+        alock_trace_end(trace);
+
+        pthread_mutex_lock(&data.resize.mutex);
+
+        /* screen has been resized in the meantime */
+        if (data.resize.cancel || data.screens[i].generation != generation) {
+            XFreePixmap(dpy, pixmap);
+            free(areas);
+            continue;
+        }
+
+        swap_pixmap(i, pixmap, areas, count);
+        data.screens[i].rendered = generation;
+        XFlush(dpy);
+
+    }
+
+    data.resize.running = 0;
+    pthread_mutex_unlock(&data.resize.mutex);
+
+    return NULL;
+}
+
+/* Request rendering of the given screen in the background. This function
+ * returns 0 if the worker takes care of the request, otherwise -1. */
+static int resize_start(int i, int width, int height) {
+
+    int rv = 0;
+
+    pthread_mutex_lock(&data.resize.mutex);
+
+    data.screens[i].width = width;
+    data.screens[i].height = height;
+    data.screens[i].generation++;
+
+    if (!data.resize.running) {
+        /* the previous worker has finished its job already */
+        if (data.resize.started)
+            pthread_join(data.resize.thread, NULL);
+        data.resize.started = 0;
+        if (pthread_create(&data.resize.thread, NULL, resize_worker, NULL) == 0)
+            data.resize.started = data.resize.running = 1;
+        else {
+            data.screens[i].rendered = data.screens[i].generation;
+            rv = -1;
+        }
+    }
+
+    pthread_mutex_unlock(&data.resize.mutex);
+    return rv;
+}
+
+/* Stop the background rendering. Request being rendered is discarded. */
+static void resize_stop(void) {
+
+    if (!data.resize.started)
+        return;
+
+    pthread_mutex_lock(&data.resize.mutex);
+    data.resize.cancel = 1;
+    pthread_mutex_unlock(&data.resize.mutex);
+
+    pthread_join(data.resize.thread, NULL);
+    data.resize.started = 0;
+    data.resize.cancel = 0;
+
+}
+
+#endif /* ENABLE_THREADS */
+
+static int module_init(Display *dpy) {
+
+    if (!data.filename && !data.outputs_count) {
+        fprintf(stderr, "[image]: file name not specified\n");
+        return -1;
+    }
+
+    if (!alock_check_xrender(dpy))
+        data.shade = 0;
+
+#if !HAVE_XRANDR
+    if (data.outputs_count)
+        fprintf(stderr, "[image]: per-output files require RandR support\n");
+#endif
+
+    int loaded = -1;
+    int i;
+
+#if ENABLE_THREADS
+    loaded = prefetch_wait();
+#endif
+
+    /* Images are decoded only once and then they are shared between all
+     * outputs and screens. The default one is required to be valid. */
+    if (loaded == 0)
+        cache_insert(data.filename, 0, 0, &data.image);
+    else if (data.filename && cache_get(data.filename, 0, 0) == NULL)
+        return -1;
+
+    data.display = dpy;
+    data.windows = (Window *)malloc(sizeof(Window) * ScreenCount(dpy));
+    data.pixmaps = (Pixmap *)malloc(sizeof(Pixmap) * ScreenCount(dpy));
+    data.screens = (struct imageScreen *)calloc(ScreenCount(dpy), sizeof(*data.screens));
+
+    for (i = 0; i < ScreenCount(dpy); i++)
+        render_screen(i);
+
     return 0;
 }
 
 static void module_free() {
 
+    unsigned int i;
+
+#if ENABLE_THREADS
+    /* initialization might not have been reached */
+    if (prefetch_wait() == 0)
+        alock_image_free(&data.image);
+    resize_stop();
+#endif
+
     if (data.windows) {
-        int i;
-        for (i = 0; i < ScreenCount(data.display); i++) {
+        for (i = 0; i < (unsigned int)ScreenCount(data.display); i++) {
             XDestroyWindow(data.display, data.windows[i]);
             XFreePixmap(data.display, data.pixmaps[i]);
+            free(data.screens[i].areas);
         }
         free(data.windows);
         free(data.pixmaps);
+        free(data.screens);
         data.windows = NULL;
         data.pixmaps = NULL;
+        data.screens = NULL;
     }
 
+    cache_free();
+
+    for (i = 0; i < data.outputs_count; i++) {
+        free(data.outputs[i].output);
+        free(data.outputs[i].filename);
+    }
+    data.outputs_count = 0;
+
     free(data.colorname);
     data.colorname = NULL;
     free(data.filename);
@@ -279,6 +897,31 @@ static Window module_getwindow(int screen) {
     return data.windows[screen];
 }
 
+/* Adjust the background to the new screen geometry. The window is resized
+ * right away (the old pixmap is tiled by the server, so the screen remains
+ * covered), then the cached decoded image is rendered at the new size. When
+ * possible, rendering is done in the background and the pixmap is swapped
+ * when it is ready. */
+static void module_resize(int screen, int width, int height) {
+
+    Display *dpy = data.display;
+    struct imageArea *areas;
+    unsigned int count;
+    Pixmap pixmap;
+
+    XResizeWindow(dpy, data.windows[screen], width, height);
+    XFlush(dpy);
+
+#if ENABLE_THREADS
+    if (resize_start(screen, width, height) == 0)
+        return;
+#endif
+
+    pixmap = render_pixmap(screen, width, height, &areas, &count);
+    swap_pixmap(screen, pixmap, areas, count);
+
+}
+
 
 struct aModuleBackground alock_bg_image = {
     { "image",
@@ -288,4 +931,5 @@ struct aModuleBackground alock_bg_image = {
         module_free,
     },
     module_getwindow,
+    module_resize,
 };
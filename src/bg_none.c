@@ -29,4 +29,5 @@ struct aModuleBackground alock_bg_none = {
         module_dummy_free,
     },
     module_getwindow,
+    NULL,
 };
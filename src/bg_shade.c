@@ -8,13 +8,16 @@
  * This project is licensed under the terms of the MIT license.
  *
  * This background module provides:
- *  -bg shade:color=<color>,shade=<int>,blur=<int>,mono
+ *  -bg shade:color=<color>,shade=<int>,blur=<int>,pixelate=<int>,mono,
+ *            budget=<KiB>
  *
  * Used resources:
  *  ALock.Background.Shade.Color
  *  ALock.Background.Shade.Shade
  *  ALock.Background.Shade.Blur
+ *  ALock.Background.Shade.Pixelate
  *  ALock.Background.Shade.Mono
+ *  ALock.Background.Shade.Budget
  *
  */
 
@@ -24,15 +27,26 @@
 #include <string.h>
 #include <X11/extensions/Xrender.h>
 
+/* strip height for the pipelined client-side capture */
+#define SHADE_CAPTURE_ROWS 256
+
 
 static struct moduleData {
     Display *display;
     Window *windows;
+    /* processed screen content and tint color */
+    Pixmap *pixmaps;
+    unsigned long *pixels;
     char *colorname;
     unsigned int shade;
     unsigned int blur;
+    unsigned int pixelate;
     char monochrome;
-} data = { NULL, NULL, NULL, 80, 0, 0 };
+    /* memory for the strip processing in KiB */
+    unsigned int budget;
+    /* monochrome conversion is done by the X server */
+    char server_mono;
+} data = { NULL, NULL, NULL, NULL, NULL, 80, 0, 0, 0, 16384, 0 };
 
 
 static void module_loadargs(const char *args) {
@@ -56,9 +70,15 @@ static void module_loadargs(const char *args) {
         else if (strstr(arg, "blur=") == arg) {
             data.blur = strtol(&arg[5], NULL, 0);
         }
+        else if (strstr(arg, "pixelate=") == arg) {
+            data.pixelate = strtol(&arg[9], NULL, 0);
+        }
         else if (strcmp(arg, "mono") == 0) {
             data.monochrome = 1;
         }
+        else if (strstr(arg, "budget=") == arg) {
+            data.budget = strtol(&arg[7], NULL, 0);
+        }
     }
 
     free(arguments);
@@ -81,10 +101,246 @@ static void module_loadxrdb(XrmDatabase xrdb) {
                 "ALock.Background.Shade.Blur", &type, &value))
         data.blur = strtol(value.addr, NULL, 0);
 
+    if (XrmGetResource(xrdb, "alock.background.shade.pixelate",
+                "ALock.Background.Shade.Pixelate", &type, &value))
+        data.pixelate = strtol(value.addr, NULL, 0);
+
     if (XrmGetResource(xrdb, "alock.background.shade.mono",
                 "ALock.Background.Shade.Mono", &type, &value))
         data.monochrome = strcmp(value.addr, "true") == 0;
 
+    if (XrmGetResource(xrdb, "alock.background.shade.budget",
+                "ALock.Background.Shade.Budget", &type, &value))
+        data.budget = strtol(value.addr, NULL, 0);
+
+}
+
+/* Get the range of the strip (with neighbouring rows) for the given rows. */
+static void strip_range(int y, int rows, int margin, int height, int *y0, int *y1) {
+    *y0 = y - margin > 0 ? y - margin : 0;
+    *y1 = y + rows + margin < height ? y + rows + margin : height;
+}
+
+/* Prepare background window for the given screen. This function is called
+ * concurrently for all screens, so it shall not modify shared data.
+ *
+ * The screen is processed in horizontal strips, which are captured into the
+ * reusable client image (client-side monochrome only) and server pixmaps, so
+ * the peak memory usage does not depend on the screen size. Strips overlap
+ * by the reach of the blur kernel, and they are aligned to the pixelate
+ * block size, hence the result does not show any seams. */
+static int init_screen(unsigned int i, void *arg) {
+    (void)arg;
+
+    Display *dpy = data.display;
+    Screen *screen = ScreenOfDisplay(dpy, i);
+    Window root = RootWindowOfScreen(screen);
+    Visual *vis = DefaultVisualOfScreen(screen);
+    Colormap colormap = DefaultColormapOfScreen(screen);
+    int client_mono = data.monochrome && !data.server_mono;
+    int width = WidthOfScreen(screen);
+    int height = HeightOfScreen(screen);
+    int depth = DefaultDepthOfScreen(screen);
+    size_t row = (size_t)width * (depth > 16 ? 4 : depth > 8 ? 2 : 1);
+    int block = data.pixelate > 1 ? data.pixelate : 1;
+    int margin = 0;
+    int rows = height;
+    int strip, y;
+    size_t client = 0, server;
+    struct aCaptureQueue queue = { 0 };
+    XImage *image = NULL;
+    int fused = 0;
+    int captured;
+    Pixmap src_pm, tmp_pm, dst_pm;
+    int trace;
+
+    trace = alock_trace_begin("shade.screen", "shade");
+
+    /* NOTE: Used kernel radius is at most 12 rows for the XRender blur
+     *       and 10 rows for the Imlib2 one (for blur value 100). */
+    if (data.blur)
+        margin = (data.blur / 8 + 4 + block - 1) / block * block;
+
+    if (data.budget) {
+
+        /* every row is stored in the source strip, in the temporary strip
+         * when blurring and in the client image in the monochrome mode */
+        size_t row_cost = row * (1 + (data.blur ? 1 : 0) + (client_mono ? 1 : 0));
+        size_t budget = (size_t)data.budget * 1024;
+
+        if (budget / row_cost < (size_t)height + 2 * margin) {
+            rows = (int)(budget / row_cost) - 2 * margin;
+            rows = rows / block * block;
+            if (rows < block)
+                rows = block;
+        }
+
+    }
+
+#if HAVE_X11_XCB
+    /* the client-side capture of the next strip is transferred while the
+     * current one is processed, so it is worth to have more strips - but
+     * only if the image is not in the shared memory, which is captured
+     * synchronously anyway */
+    if (client_mono && !alock_check_xshm(dpy) && rows > SHADE_CAPTURE_ROWS)
+        rows = SHADE_CAPTURE_ROWS > block ? SHADE_CAPTURE_ROWS / block * block : block;
+#endif
+
+    if (rows >= height) {
+        rows = height;
+        margin = 0;
+    }
+
+    strip = rows + 2 * margin < height ? rows + 2 * margin : height;
+    debug("screen %u: %d strips of %d rows", i, (height + rows - 1) / rows, rows);
+
+    XColor color;
+    alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
+    data.pixels[i] = color.pixel;
+
+    XGCValues gcval = {
+        .foreground = color.pixel,
+        .subwindow_mode = IncludeInferiors,
+    };
+    GC gc = XCreateGC(dpy, root, GCForeground | GCSubwindowMode, &gcval);
+
+    dst_pm = XCreatePixmap(dpy, root, width, height, depth);
+    src_pm = XCreatePixmap(dpy, root, width, strip, depth);
+    server = row * (height + strip);
+
+    /* processed content can be stored directly in the final pixmap, unless
+     * it is going to be blurred in parts */
+    tmp_pm = dst_pm;
+    if (data.blur && rows < height) {
+        tmp_pm = XCreatePixmap(dpy, root, width, strip, depth);
+        server += row * strip;
+    }
+
+    if (client_mono) {
+        if ((image = alock_create_image(dpy, vis, depth, width, strip)) != NULL)
+            client = (size_t)image->bytes_per_line * strip;
+        else
+            fprintf(stderr, "[shade]: unable to allocate image buffer\n");
+    }
+
+    if (image != NULL) {
+        int y0, y1;
+        strip_range(0, rows, margin, height, &y0, &y1);
+        alock_capture_request(dpy, &queue, root, image, 0, y0, y1 - y0);
+    }
+
+    for (y = 0; y < height; y += rows) {
+
+        /* processed rows and the strip with neighbouring rows */
+        int n = rows < height - y ? rows : height - y;
+        int y0, y1;
+
+        strip_range(y, rows, margin, height, &y0, &y1);
+
+        captured = 0;
+        if (image != NULL) {
+
+            /* request the next strip before the current one is processed */
+            if (y + rows < height) {
+                int next0, next1;
+                strip_range(y + rows, rows, margin, height, &next0, &next1);
+                alock_capture_request(dpy, &queue, root, image, 0, next0, next1 - next0);
+            }
+
+            /* if the pipelined capture has failed, try the synchronous one */
+            if (alock_capture_fetch(dpy, &queue, image) == 0 ||
+                    alock_capture_image(dpy, root, image, 0, y0, y1 - y0) == 0)
+                captured = 1;
+            else {
+                fprintf(stderr, "[shade]: unable to capture screen content\n");
+                fused = 0;
+            }
+
+        }
+
+        if (captured) {
+
+            /* grab whats on the screen and convert it to monochrome - if
+             * possible, tint and shade it in the same pass */
+            if (!(fused = alock_grayscale_shade_image(image, 0, 0, width, y1 - y0,
+                            &color, data.shade)))
+                alock_grayscale_image(image, 0, 0, width, y1 - y0);
+            alock_upload_image(dpy, src_pm, gc, image, 0, 0, 0, 0, width, y1 - y0, "shade");
+
+        }
+        else
+            /* the content does not have to leave the server at all (or the
+             * capture has failed, so at least the shading is applied) */
+            XCopyArea(dpy, root, src_pm, gc, 0, y0, width, y1 - y0, 0, 0);
+
+        /* The blur kernel reaches past the processed rows, so rows of the
+         * strip which were not filled (the first and the last strip might be
+         * shorter) have to be cleared - otherwise rows of the previous strip
+         * would leak in. Zero matches the area beyond the pixmap edge. */
+        if (data.blur && y1 - y0 < strip) {
+            XSetForeground(dpy, gc, 0);
+            XFillRectangle(dpy, src_pm, gc, 0, y1 - y0, width, strip - (y1 - y0));
+            if (!fused && tmp_pm != dst_pm)
+                XFillRectangle(dpy, tmp_pm, gc, 0, y1 - y0, width, strip - (y1 - y0));
+            XSetForeground(dpy, gc, color.pixel);
+        }
+
+        if (data.server_mono)
+            alock_grayscale_pixmap(dpy, vis, src_pm, width, y1 - y0);
+
+        alock_pixelate_pixmap(dpy, vis, src_pm, data.pixelate, width, y1 - y0);
+
+        if (fused && data.blur) {
+            alock_blur_pixmap(dpy, vis, src_pm, tmp_pm, data.blur,
+                    0, 0, 0, 0, width, y1 - y0);
+            if (tmp_pm != dst_pm)
+                XCopyArea(dpy, tmp_pm, dst_pm, gc, 0, y - y0, width, n, 0, y);
+        }
+        else if (fused)
+            XCopyArea(dpy, src_pm, dst_pm, gc, 0, y - y0, width, n, 0, y);
+        else if (data.blur) {
+            XFillRectangle(dpy, tmp_pm, gc, 0, 0, width, y1 - y0);
+            alock_shade_pixmap(dpy, vis, src_pm, tmp_pm, data.shade,
+                    0, 0, 0, 0, width, y1 - y0);
+            alock_blur_pixmap(dpy, vis, tmp_pm, src_pm, data.blur,
+                    0, 0, 0, 0, width, y1 - y0);
+            XCopyArea(dpy, src_pm, dst_pm, gc, 0, y - y0, width, n, 0, y);
+        }
+        else {
+            XFillRectangle(dpy, dst_pm, gc, 0, y, width, n);
+            alock_shade_pixmap(dpy, vis, src_pm, dst_pm, data.shade,
+                    0, y - y0, 0, y, width, n);
+        }
+
+    }
+
+    if (image != NULL)
+        alock_destroy_image(dpy, image);
+    if (tmp_pm != dst_pm)
+        XFreePixmap(dpy, tmp_pm);
+    XFreePixmap(dpy, src_pm);
+    XFreeGC(dpy, gc);
+
+    debug("screen %u: peak memory: %zu client + %zu server bytes", i, client, server);
+    alock_trace_arg(trace, "peak", client + server);
+    alock_trace_end(trace);
+
+    /* create final window */
+    XSetWindowAttributes xswa = {
+        .background_pixmap = dst_pm,
+        .override_redirect = True,
+        .colormap = colormap,
+    };
+    data.windows[i] = XCreateWindow(dpy, root,
+            0, 0, width, height, 0,
+            CopyFromParent, InputOutput, CopyFromParent,
+            CWOverrideRedirect | CWColormap | CWBackPixmap,
+            &xswa);
+
+    /* processed pixmap is kept for the screen reconfiguration */
+    data.pixmaps[i] = dst_pm;
+
+    return 0;
 }
 
 static int module_init(Display *dpy) {
@@ -98,71 +354,33 @@ static int module_init(Display *dpy) {
     if (data.blur > 100)
         fprintf(stderr, "[shade]: blur not in range [0, 100]\n");
 
+    /* client-side conversion is used only as a fallback */
+    if (data.monochrome)
+        data.server_mono = alock_check_xrender_blend(dpy);
+
     data.display = dpy;
     data.windows = (Window *)malloc(sizeof(Window) * ScreenCount(dpy));
+    data.pixmaps = (Pixmap *)malloc(sizeof(Pixmap) * ScreenCount(dpy));
+    data.pixels = (unsigned long *)malloc(sizeof(unsigned long) * ScreenCount(dpy));
 
-    int i;
-
-    for (i = 0; i < ScreenCount(dpy); i++) {
-
-        Screen *screen = ScreenOfDisplay(dpy, i);
-        Window root = RootWindowOfScreen(screen);
-        Colormap colormap = DefaultColormapOfScreen(screen);
-        GC gc = DefaultGCOfScreen(screen);
-        int width = WidthOfScreen(screen);
-        int height = HeightOfScreen(screen);
-        int depth = DefaultDepthOfScreen(screen);
-
-        /* grab whats on the screen */
-        XImage *image = XGetImage(dpy, root, 0, 0, width, height, AllPlanes, ZPixmap);
-        if (data.monochrome)  /* optional monochrome conversion */
-            alock_grayscale_image(image, 0, 0, width, height);
-        Pixmap src_pm = XCreatePixmap(dpy, root, width, height, depth);
-        XPutImage(dpy, src_pm, gc, image, 0, 0, 0, 0, width, height);
-        XDestroyImage(image);
-
-        XColor color;
-        alock_alloc_color(dpy, colormap, data.colorname, "black", &color);
-        XGCValues tintval = { .foreground = color.pixel };
-
-        Pixmap dst_pm = XCreatePixmap(dpy, root, width, height, depth);
-        GC tintgc = XCreateGC(dpy, dst_pm, GCForeground, &tintval);
-        XFillRectangle(dpy, dst_pm, tintgc, 0, 0, width, height);
-        XFreeGC(dpy, tintgc);
-
-        Visual *vis = DefaultVisualOfScreen(screen);
-        alock_shade_pixmap(dpy, vis, src_pm, dst_pm, data.shade, 0, 0, 0, 0, width, height);
-        XCopyArea(dpy, dst_pm, src_pm, gc, 0, 0, width, height, 0, 0);
-        alock_blur_pixmap(dpy, vis, src_pm, dst_pm, data.blur, 0, 0, 0, 0, width, height);
-
-        /* create final window */
-        XSetWindowAttributes xswa = {
-            .background_pixmap = dst_pm,
-            .override_redirect = True,
-            .colormap = colormap,
-        };
-        data.windows[i] = XCreateWindow(dpy, root,
-                0, 0, width, height, 0,
-                CopyFromParent, InputOutput, CopyFromParent,
-                CWOverrideRedirect | CWColormap | CWBackPixmap,
-                &xswa);
-
-        XFreePixmap(dpy, src_pm);
-        XFreePixmap(dpy, dst_pm);
-
-    }
-
-    return 0;
+    /* capture, blur and shade all screens concurrently */
+    return alock_parallel(ScreenCount(dpy), init_screen, NULL);
 }
 
 static void module_free() {
 
     if (data.windows) {
         int i;
-        for (i = 0; i < ScreenCount(data.display); i++)
+        for (i = 0; i < ScreenCount(data.display); i++) {
             XDestroyWindow(data.display, data.windows[i]);
+            XFreePixmap(data.display, data.pixmaps[i]);
+        }
         free(data.windows);
+        free(data.pixmaps);
+        free(data.pixels);
         data.windows = NULL;
+        data.pixmaps = NULL;
+        data.pixels = NULL;
     }
 
     free(data.colorname);
@@ -176,6 +394,40 @@ static Window module_getwindow(int screen) {
     return data.windows[screen];
 }
 
+/* Adjust the background to the new screen geometry. The content of the newly
+ * exposed part of the screen is covered by our window, so it can not be
+ * captured. Instead, the already processed content is reused and the rest
+ * of the screen is filled with the tint color. */
+static void module_resize(int screen, int width, int height) {
+
+    Display *dpy = data.display;
+    Window root = RootWindow(dpy, screen);
+    int depth = DefaultDepth(dpy, screen);
+    XGCValues gcval = { .foreground = data.pixels[screen] };
+    Pixmap pixmap;
+    Window r;
+    int x, y;
+    unsigned int w, h, b, d;
+    GC gc;
+
+    XGetGeometry(dpy, data.pixmaps[screen], &r, &x, &y, &w, &h, &b, &d);
+    debug("resize background: %ux%u -> %dx%d", w, h, width, height);
+
+    pixmap = XCreatePixmap(dpy, root, width, height, depth);
+    gc = XCreateGC(dpy, pixmap, GCForeground, &gcval);
+    XFillRectangle(dpy, pixmap, gc, 0, 0, width, height);
+    XCopyArea(dpy, data.pixmaps[screen], pixmap, gc, 0, 0, w, h, 0, 0);
+    XFreeGC(dpy, gc);
+
+    XSetWindowBackgroundPixmap(dpy, data.windows[screen], pixmap);
+    XResizeWindow(dpy, data.windows[screen], width, height);
+    XClearWindow(dpy, data.windows[screen]);
+
+    XFreePixmap(dpy, data.pixmaps[screen]);
+    data.pixmaps[screen] = pixmap;
+
+}
+
 
 struct aModuleBackground alock_bg_shade = {
     { "shade",
@@ -185,4 +437,5 @@ struct aModuleBackground alock_bg_shade = {
         module_free,
     },
     module_getwindow,
+    module_resize,
 };
@@ -115,7 +115,7 @@ static int module_init(Display *dpy) {
 
                     cursor_pm = XCreatePixmap(dpy, RootWindowOfScreen(screen), w, h, 32);
                     gc = XCreateGC(dpy, cursor_pm, 0, 0);
-                    XPutImage(dpy, cursor_pm, gc, &ximage, 0, 0, 0, 0, w, h);
+                    alock_upload_image(dpy, cursor_pm, gc, &ximage, 0, 0, 0, 0, w, h, "image");
                     XFreeGC(dpy, gc);
                 }
                 imlib_free_image_and_decache();
@@ -134,7 +134,7 @@ static int module_init(Display *dpy) {
 
                 cursor_pm = XCreatePixmap(dpy, RootWindowOfScreen(screen), w, h, img->depth);
                 gc = XCreateGC(dpy, cursor_pm, 0, NULL);
-                XPutImage(dpy, cursor_pm, gc, img, 0, 0, 0, 0, w, h);
+                alock_upload_image(dpy, cursor_pm, gc, img, 0, 0, 0, 0, w, h, "image");
                 XFreeGC(dpy, gc);
                 XDestroyImage(img);
             }
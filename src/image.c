@@ -0,0 +1,724 @@
+/*
+ * alock - image.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * Image helpers used by the background modules. Uncompressed or cheap to
+ * decode formats (farbfeld, PPM/PGM, PAM and QOI) are decoded directly from
+ * the memory-mapped file, other ones are loaded with the Imlib2 library (if
+ * available). Decoded pixels are stored in the native-endian ARGB32 format,
+ * which is the layout of the XImage for the 24/32-bit TrueColor visual, so
+ * in the common case rows are uploaded to the X server as they are.
+ *
+ */
+
+#include "alock.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
+#if ENABLE_IMLIB2
+# include <Imlib2.h>
+#endif
+
+
+/* upper limit for the number of pixels (the same as in the QOI spec) */
+#define IMAGE_PIXELS_MAX 400000000
+
+static int image_alloc(struct aImage *image, unsigned long width, unsigned long height) {
+
+    size_t size;
+
+    /* NOTE: The product of dimensions might wrap around on 32-bit platforms,
+     *       so the limit is checked with the division instead. */
+    if (width == 0 || height == 0 || width > IMAGE_PIXELS_MAX / height)
+        return -1;
+    if (width * height > SIZE_MAX / sizeof(*image->pixels))
+        return -1;
+
+    size = sizeof(*image->pixels) * width * height;
+    if ((image->pixels = malloc(size)) == NULL)
+        return -1;
+
+    image->width = width;
+    image->height = height;
+
+    return 0;
+}
+
+static uint32_t read_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* Decode farbfeld image - 16-bit big-endian RGBA samples. */
+static int decode_farbfeld(struct aImage *image, const unsigned char *data, size_t size) {
+
+    const unsigned char *p = &data[16];
+    size_t i, count;
+
+    if (size < 16 || image_alloc(image, read_be32(&data[8]), read_be32(&data[12])) != 0)
+        return -1;
+
+    count = (size_t)image->width * image->height;
+    if ((size - 16) / 8 < count) {
+        alock_image_free(image);
+        return -1;
+    }
+
+    /* only the most significant byte of every sample is used */
+    for (i = 0; i < count; i++, p += 8)
+        image->pixels[i] = (uint32_t)p[6] << 24 | p[0] << 16 | p[2] << 8 | p[4];
+
+    return 0;
+}
+
+/* Get the next header token of the Netpbm image. Comments are skipped. */
+static const unsigned char *pnm_token(const unsigned char *p, const unsigned char *end,
+        char *token, size_t size) {
+
+    size_t i = 0;
+
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+        if (p < end && *p == '#') {
+            while (p < end && *p != '\n')
+                p++;
+            continue;
+        }
+        break;
+    }
+
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        if (i < size - 1)
+            token[i++] = *p;
+        p++;
+    }
+
+    token[i] = '\0';
+    return p;
+}
+
+/* Decode PGM (P5), PPM (P6) or PAM (P7) image. Gray-scale, RGB, with or
+ * without alpha channel, and with 8-bit or 16-bit samples are supported. */
+static int decode_pnm(struct aImage *image, const unsigned char *data, size_t size) {
+
+    const unsigned char *end = &data[size];
+    const unsigned char *p = &data[2];
+    unsigned long width = 0, height = 0, maxval = 0;
+    unsigned int channels = 0;
+    unsigned int bps, c;
+    size_t i, count;
+    char token[32];
+
+    if (data[1] == '5' || data[1] == '6') {
+        channels = data[1] == '5' ? 1 : 3;
+        p = pnm_token(p, end, token, sizeof(token));
+        width = strtoul(token, NULL, 10);
+        p = pnm_token(p, end, token, sizeof(token));
+        height = strtoul(token, NULL, 10);
+        p = pnm_token(p, end, token, sizeof(token));
+        maxval = strtoul(token, NULL, 10);
+        /* single white-space character precedes the raster */
+        p++;
+    }
+    else if (data[1] == '7') {
+        for (;;) {
+            p = pnm_token(p, end, token, sizeof(token));
+            if (token[0] == '\0')
+                return -1;
+            if (strcmp(token, "ENDHDR") == 0) {
+                while (p < end && *p++ != '\n')
+                    continue;
+                break;
+            }
+            if (strcmp(token, "WIDTH") == 0) {
+                p = pnm_token(p, end, token, sizeof(token));
+                width = strtoul(token, NULL, 10);
+            }
+            else if (strcmp(token, "HEIGHT") == 0) {
+                p = pnm_token(p, end, token, sizeof(token));
+                height = strtoul(token, NULL, 10);
+            }
+            else if (strcmp(token, "DEPTH") == 0) {
+                p = pnm_token(p, end, token, sizeof(token));
+                channels = strtoul(token, NULL, 10);
+            }
+            else if (strcmp(token, "MAXVAL") == 0) {
+                p = pnm_token(p, end, token, sizeof(token));
+                maxval = strtoul(token, NULL, 10);
+            }
+            else /* TUPLTYPE is implied by the depth */
+                while (p < end && *p != '\n')
+                    p++;
+        }
+    }
+
+    if (channels < 1 || channels > 4 || maxval < 1 || maxval > 65535 || p > end)
+        return -1;
+    if (image_alloc(image, width, height) != 0)
+        return -1;
+
+    bps = maxval > 255 ? 2 : 1;
+    count = (size_t)width * height;
+    if ((size_t)(end - p) / (channels * bps) < count) {
+        alock_image_free(image);
+        return -1;
+    }
+
+    /* the most common case - 8-bit RGB samples */
+    if (channels == 3 && maxval == 255) {
+        for (i = 0; i < count; i++, p += 3)
+            image->pixels[i] = 0xff000000 | p[0] << 16 | p[1] << 8 | p[2];
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+
+        unsigned int v[4] = { 0, 0, 0, 255 };
+
+        for (c = 0; c < channels; c++, p += bps) {
+            v[c] = bps == 2 ? (p[0] << 8 | p[1]) : p[0];
+            if (maxval != 255)
+                v[c] = v[c] * 255 / maxval;
+        }
+
+        if (channels <= 2) { /* gray-scale with optional alpha */
+            v[3] = channels == 2 ? v[1] : 255;
+            v[1] = v[2] = v[0];
+        }
+
+        image->pixels[i] = (uint32_t)v[3] << 24 | v[0] << 16 | v[1] << 8 | v[2];
+    }
+
+    return 0;
+}
+
+/* Decode QOI (Quite OK Image) image. */
+static int decode_qoi(struct aImage *image, const unsigned char *data, size_t size) {
+
+    const unsigned char *end;
+    const unsigned char *p = &data[14];
+    unsigned char index[64][4] = { { 0 } };
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    unsigned int run = 0;
+    size_t i, count;
+
+    if (size < 22 || image_alloc(image, read_be32(&data[4]), read_be32(&data[8])) != 0)
+        return -1;
+
+    /* the last 8 bytes are the end-of-stream marker */
+    end = &data[size - 8];
+
+    count = (size_t)image->width * image->height;
+    for (i = 0; i < count; i++) {
+
+        if (run > 0)
+            run--;
+        else if (p < end) {
+
+            unsigned char b1 = *p++;
+
+            if (b1 == 0xfe && p + 3 <= end) { /* QOI_OP_RGB */
+                px[0] = p[0];
+                px[1] = p[1];
+                px[2] = p[2];
+                p += 3;
+            }
+            else if (b1 == 0xff && p + 4 <= end) { /* QOI_OP_RGBA */
+                memcpy(px, p, 4);
+                p += 4;
+            }
+            else if ((b1 & 0xc0) == 0x00) /* QOI_OP_INDEX */
+                memcpy(px, index[b1], 4);
+            else if ((b1 & 0xc0) == 0x40) { /* QOI_OP_DIFF */
+                px[0] += ((b1 >> 4) & 0x03) - 2;
+                px[1] += ((b1 >> 2) & 0x03) - 2;
+                px[2] += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & 0xc0) == 0x80 && p < end) { /* QOI_OP_LUMA */
+                unsigned char b2 = *p++;
+                int vg = (b1 & 0x3f) - 32;
+                px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+                px[1] += vg;
+                px[2] += vg - 8 + (b2 & 0x0f);
+            }
+            else if ((b1 & 0xc0) == 0xc0) /* QOI_OP_RUN */
+                run = b1 & 0x3f;
+
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+
+        }
+
+        image->pixels[i] = (uint32_t)px[3] << 24 | px[0] << 16 | px[1] << 8 | px[2];
+    }
+
+    return 0;
+}
+
+#if ENABLE_IMLIB2
+/* Load image with the Imlib2 library. Its internal ARGB32 representation
+ * is the same as ours, so the data is simply copied. */
+static int load_imlib(struct aImage *image, const char *filename) {
+
+#if ENABLE_THREADS
+    /* Imlib2 context stack is global, hence not thread-safe. */
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+#endif
+
+    Imlib_Context ctx = imlib_context_new();
+    Imlib_Image img;
+    int rv = -1;
+
+    imlib_context_push(ctx);
+
+    if ((img = imlib_load_image_without_cache(filename)) != NULL) {
+        imlib_context_set_image(img);
+        if (image_alloc(image, imlib_image_get_width(), imlib_image_get_height()) == 0) {
+            memcpy(image->pixels, imlib_image_get_data_for_reading_only(),
+                    sizeof(*image->pixels) * image->width * image->height);
+            rv = 0;
+        }
+        imlib_free_image_and_decache();
+    }
+
+    imlib_context_pop();
+    imlib_context_free(ctx);
+
+#if ENABLE_THREADS
+    pthread_mutex_unlock(&mutex);
+#endif
+    return rv;
+}
+#endif
+
+/* Decode image from the given file with the built-in decoders. This function
+ * returns 0 on success, 1 if the file can not be decoded natively (e.g. the
+ * format is not supported), otherwise -1. The file is not closed. */
+int alock_image_decode(struct aImage *image, int fd) {
+
+    int (*decode)(struct aImage *, const unsigned char *, size_t) = NULL;
+    unsigned char *data;
+    struct stat st;
+    int rv = 1;
+
+    memset(image, 0, sizeof(*image));
+
+    if (fstat(fd, &st) == -1 || st.st_size < 16)
+        return 1;
+    if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        return 1;
+
+    if (memcmp(data, "farbfeld", 8) == 0)
+        decode = decode_farbfeld;
+    else if (data[0] == 'P' && data[1] >= '5' && data[1] <= '7')
+        decode = decode_pnm;
+    else if (memcmp(data, "qoif", 4) == 0)
+        decode = decode_qoi;
+
+    if (decode != NULL) {
+        /* every decoder reads the file from the beginning to the end */
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        rv = decode(image, data, st.st_size) == 0 ? 0 : -1;
+    }
+
+    munmap(data, st.st_size);
+    return rv;
+}
+
+/* Load image from the given file. On success this function returns 0,
+ * otherwise -1. Returned image should be freed with alock_image_free().
+ *
+ * NOTE: The file is opened with the rights of the real user, however the
+ *       Imlib2 library opens it on its own. */
+int alock_image_load(struct aImage *image, const char *filename) {
+
+    int rv;
+    int fd;
+
+    memset(image, 0, sizeof(*image));
+
+    if ((fd = alock_open_user(filename, O_RDONLY, 0)) == -1)
+        return -1;
+
+    if ((rv = alock_image_decode(image, fd)) == -1)
+        fprintf(stderr, "alock: malformed image file: %s\n", filename);
+
+    close(fd);
+
+#if ENABLE_IMLIB2
+    if (rv == 1)
+        rv = load_imlib(image, filename);
+#endif
+
+    return rv == 0 ? 0 : -1;
+}
+
+/* Release resources allocated for the given image. */
+void alock_image_free(struct aImage *image) {
+    free(image->pixels);
+    image->pixels = NULL;
+    image->width = 0;
+    image->height = 0;
+}
+
+/* Filter weights of one output pixel. Weights are stored in the 14-bit
+ * fixed-point precision and their sum is always equal to 1. */
+struct scaleContrib {
+    unsigned int start;
+    unsigned int count;
+};
+
+struct scaleKernel {
+    struct scaleContrib *contribs;
+    int16_t *weights;
+    unsigned int stride;
+};
+
+struct scaleData {
+    const struct aImage *src;
+    struct aImage *dst;
+    struct scaleKernel kernel;
+};
+
+/* number of rows processed by one parallel task */
+#define SCALE_BAND_ROWS 32
+
+static double filter_bilinear(double x) {
+    x = fabs(x);
+    return x < 1 ? 1 - x : 0;
+}
+
+static double filter_lanczos3(double x) {
+    if (x == 0)
+        return 1;
+    if (x <= -3 || x >= 3)
+        return 0;
+    x *= M_PI;
+    return 3 * sin(x) * sin(x / 3) / (x * x);
+}
+
+/* Calculate filter weights for the one-dimensional scaling. When the image
+ * is downscaled, the filter is widened accordingly, so every source pixel
+ * contributes to the result (no aliasing). */
+static int scale_kernel_init(struct scaleKernel *kernel, unsigned int src_size,
+        unsigned int dst_size, enum aImageFilter filter) {
+
+    double (*func)(double) = filter_bilinear;
+    double support = 1;
+    double scale = (double)src_size / dst_size;
+    double fscale = scale > 1 ? scale : 1;
+    double *tmp;
+    unsigned int i, j;
+
+    if (filter == AIMAGE_FILTER_LANCZOS3) {
+        func = filter_lanczos3;
+        support = 3;
+    }
+
+    support *= fscale;
+    kernel->stride = (unsigned int)ceil(support) * 2 + 1;
+    kernel->contribs = malloc(sizeof(*kernel->contribs) * dst_size);
+    kernel->weights = malloc(sizeof(*kernel->weights) * dst_size * kernel->stride);
+    tmp = malloc(sizeof(*tmp) * kernel->stride);
+
+    if (kernel->contribs == NULL || kernel->weights == NULL || tmp == NULL) {
+        free(kernel->contribs);
+        free(kernel->weights);
+        free(tmp);
+        return -1;
+    }
+
+    for (i = 0; i < dst_size; i++) {
+
+        struct scaleContrib *c = &kernel->contribs[i];
+        int16_t *weights = &kernel->weights[i * kernel->stride];
+        double center = (i + 0.5) * scale;
+        long start = floor(center - support);
+        long end = ceil(center + support);
+        double sum = 0;
+        int total = 0;
+        unsigned int max = 0;
+
+        if (start < 0)
+            start = 0;
+        if (end > (long)src_size)
+            end = src_size;
+        if (end - start > (long)kernel->stride)
+            end = start + kernel->stride;
+
+        c->start = start;
+        c->count = end - start;
+
+        for (j = 0; j < c->count; j++) {
+            tmp[j] = func((start + j + 0.5 - center) / fscale);
+            sum += tmp[j];
+        }
+
+        for (j = 0; j < c->count; j++) {
+            weights[j] = lround(tmp[j] / sum * (1 << 14));
+            total += weights[j];
+            if (weights[j] > weights[max])
+                max = j;
+        }
+
+        /* compensate the rounding error */
+        weights[max] += (1 << 14) - total;
+
+    }
+
+    free(tmp);
+    return 0;
+}
+
+static void scale_kernel_free(struct scaleKernel *kernel) {
+    free(kernel->contribs);
+    free(kernel->weights);
+}
+
+/* Convert accumulated fixed-point channel value into the 8-bit one. */
+static uint32_t scale_clamp(int value) {
+    value = (value + (1 << 13)) >> 14;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static uint32_t scale_pack(int a, int r, int g, int b) {
+    return scale_clamp(a) << 24 | scale_clamp(r) << 16 | scale_clamp(g) << 8 | scale_clamp(b);
+}
+
+/* Scale one band of rows in the horizontal direction. */
+static int scale_horizontal(unsigned int band, void *arg) {
+
+    struct scaleData *sd = (struct scaleData *)arg;
+    const struct scaleKernel *k = &sd->kernel;
+    unsigned int y = band * SCALE_BAND_ROWS;
+    unsigned int end = y + SCALE_BAND_ROWS;
+    unsigned int x, j;
+
+    if (end > sd->src->height)
+        end = sd->src->height;
+
+    for (; y < end; y++) {
+
+        const uint32_t *in = &sd->src->pixels[(size_t)y * sd->src->width];
+        uint32_t *out = &sd->dst->pixels[(size_t)y * sd->dst->width];
+
+        for (x = 0; x < sd->dst->width; x++) {
+
+            const struct scaleContrib *contrib = &k->contribs[x];
+            const int16_t *weights = &k->weights[x * k->stride];
+            const uint32_t *p = &in[contrib->start];
+            int a = 0, r = 0, g = 0, b = 0;
+
+            for (j = 0; j < contrib->count; j++) {
+                a += (int)(p[j] >> 24) * weights[j];
+                r += (int)((p[j] >> 16) & 0xff) * weights[j];
+                g += (int)((p[j] >> 8) & 0xff) * weights[j];
+                b += (int)(p[j] & 0xff) * weights[j];
+            }
+
+            out[x] = scale_pack(a, r, g, b);
+        }
+
+    }
+
+    return 0;
+}
+
+/* Scale one band of rows in the vertical direction. Source rows are
+ * accumulated one after another, so the memory is accessed sequentially. */
+static int scale_vertical(unsigned int band, void *arg) {
+
+    struct scaleData *sd = (struct scaleData *)arg;
+    const struct scaleKernel *k = &sd->kernel;
+    const unsigned int width = sd->dst->width;
+    unsigned int y = band * SCALE_BAND_ROWS;
+    unsigned int end = y + SCALE_BAND_ROWS;
+    unsigned int x, j;
+    int *acc;
+
+    if (end > sd->dst->height)
+        end = sd->dst->height;
+    if ((acc = malloc(sizeof(*acc) * 4 * width)) == NULL)
+        return -1;
+
+    for (; y < end; y++) {
+
+        const struct scaleContrib *contrib = &k->contribs[y];
+        const int16_t *weights = &k->weights[y * k->stride];
+        uint32_t *out = &sd->dst->pixels[(size_t)y * width];
+
+        memset(acc, 0, sizeof(*acc) * 4 * width);
+
+        for (j = 0; j < contrib->count; j++) {
+            const uint32_t *in = &sd->src->pixels[(size_t)(contrib->start + j) * width];
+            const int w = weights[j];
+            for (x = 0; x < width; x++) {
+                acc[x * 4 + 0] += (int)(in[x] >> 24) * w;
+                acc[x * 4 + 1] += (int)((in[x] >> 16) & 0xff) * w;
+                acc[x * 4 + 2] += (int)((in[x] >> 8) & 0xff) * w;
+                acc[x * 4 + 3] += (int)(in[x] & 0xff) * w;
+            }
+        }
+
+        for (x = 0; x < width; x++)
+            out[x] = scale_pack(acc[x * 4], acc[x * 4 + 1], acc[x * 4 + 2], acc[x * 4 + 3]);
+
+    }
+
+    free(acc);
+    return 0;
+}
+
+/* Scale given image to the new size with the given filter. The separable
+ * filter is applied in two passes (horizontal and vertical), and every pass
+ * is distributed among all CPUs in bands of rows. On success this function
+ * returns 0, otherwise -1. */
+int alock_image_scale(struct aImage *dst, const struct aImage *src,
+        unsigned int width, unsigned int height, enum aImageFilter filter) {
+
+    struct scaleData sd;
+    struct aImage tmp = { 0 };
+    int rv = -1;
+
+    if (image_alloc(dst, width, height) != 0)
+        return -1;
+
+    sd.src = src;
+
+    if (src->width != width) {
+        /* when the height is not changed, there is no need for the second pass */
+        if (src->height == height)
+            sd.dst = dst;
+        else if (image_alloc(&tmp, width, src->height) == 0)
+            sd.dst = &tmp;
+        else
+            goto fail;
+        if (scale_kernel_init(&sd.kernel, src->width, width, filter) != 0)
+            goto fail;
+        rv = alock_parallel((src->height + SCALE_BAND_ROWS - 1) / SCALE_BAND_ROWS,
+                scale_horizontal, &sd);
+        scale_kernel_free(&sd.kernel);
+        if (rv != 0)
+            goto fail;
+        sd.src = sd.dst;
+    }
+
+    if (src->height != height) {
+        sd.dst = dst;
+        if (scale_kernel_init(&sd.kernel, src->height, height, filter) != 0)
+            goto fail;
+        rv = alock_parallel((height + SCALE_BAND_ROWS - 1) / SCALE_BAND_ROWS,
+                scale_vertical, &sd);
+        scale_kernel_free(&sd.kernel);
+        if (rv != 0)
+            goto fail;
+    }
+
+    if (src->width == width && src->height == height)
+        memcpy(dst->pixels, src->pixels, sizeof(*dst->pixels) * width * height);
+
+    alock_image_free(&tmp);
+    return 0;
+
+fail:
+    alock_image_free(&tmp);
+    alock_image_free(dst);
+    return -1;
+}
+
+/* Convert 8-bit color component into the pixel value part described by the
+ * given visual mask. */
+static unsigned long mask_component(unsigned int value, unsigned long mask) {
+
+    int shift = 0, bits = 0;
+
+    if (mask == 0)
+        return 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    while (mask & 1) {
+        mask >>= 1;
+        bits++;
+    }
+
+    if (bits < 8)
+        value >>= 8 - bits;
+    else
+        value <<= bits - 8;
+
+    return (unsigned long)value << shift;
+}
+
+/* Upload given image into the new pixmap. If the layout of the visual
+ * matches the one of the image, pixels are copied without the conversion.
+ * On error this function returns None. */
+Pixmap alock_image_pixmap(Display *display, Drawable drawable, Visual *visual,
+        int depth, const struct aImage *image) {
+
+    XImage *ximage;
+    Pixmap pixmap;
+    GC gc;
+
+    if (visual->class != TrueColor && visual->class != DirectColor) {
+        fprintf(stderr, "alock: visual class %d is not supported\n", visual->class);
+        return None;
+    }
+
+    if ((ximage = alock_create_image(display, visual, depth,
+                    image->width, image->height)) == NULL)
+        return None;
+
+    if (ximage->bits_per_pixel == 32 &&
+            visual->red_mask == 0xff0000 &&
+            visual->green_mask == 0x00ff00 &&
+            visual->blue_mask == 0x0000ff) {
+
+        unsigned int y;
+
+        ximage->byte_order = alock_native_byte_order();
+        for (y = 0; y < image->height; y++)
+            memcpy(&ximage->data[(size_t)y * ximage->bytes_per_line],
+                    &image->pixels[(size_t)y * image->width],
+                    sizeof(*image->pixels) * image->width);
+
+    }
+    else {
+
+        unsigned int x, y;
+
+        for (y = 0; y < image->height; y++)
+            for (x = 0; x < image->width; x++) {
+                const uint32_t p = image->pixels[(size_t)y * image->width + x];
+                XPutPixel(ximage, x, y,
+                        mask_component((p >> 16) & 0xff, visual->red_mask) |
+                        mask_component((p >> 8) & 0xff, visual->green_mask) |
+                        mask_component(p & 0xff, visual->blue_mask));
+            }
+
+    }
+
+    pixmap = XCreatePixmap(display, drawable, image->width, image->height, depth);
+    gc = XCreateGC(display, pixmap, 0, NULL);
+    alock_upload_image(display, pixmap, gc, ximage, 0, 0, 0, 0,
+            image->width, image->height, "image");
+    XFreeGC(display, gc);
+    alock_destroy_image(display, ximage);
+
+    return pixmap;
+}
@@ -0,0 +1,563 @@
+/*
+ * alock - input_dots.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This input module provides:
+ *  -input dots:input=<color>,check=<color>,error=<color>,bg=<color>,size=<int>,max=<int>
+ *
+ * Used resources:
+ *  ALock.Input.Dots.Color.Input
+ *  ALock.Input.Dots.Color.Check
+ *  ALock.Input.Dots.Color.Error
+ *  ALock.Input.Dots.Color.Background
+ *  ALock.Input.Dots.Size
+ *  ALock.Input.Dots.Max
+ *
+ * Password length indicator, which displays one dot per entered character
+ * and the current cursor position in the center of every monitor (RandR
+ * CRTC). Indicators of one screen share a window, which is shaped to their
+ * areas. All slot graphics are rendered once during the initialization, so
+ * upon a keystroke only changed slots are composited into the window.
+ *
+ */
+
+#include "alock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/Xrender.h>
+#if HAVE_XEXT
+# include <X11/extensions/shape.h>
+#endif
+#if HAVE_XRANDR
+# include <X11/extensions/Xrandr.h>
+#endif
+
+
+/* pre-rendered slot graphics */
+enum dotsPicture {
+    DOTS_PICTURE_EMPTY,
+    DOTS_PICTURE_INPUT,
+    DOTS_PICTURE_CHECK,
+    DOTS_PICTURE_ERROR,
+    DOTS_PICTURE_CURSOR,
+    DOTS_PICTURE_BLANK,
+    DOTS_PICTURE_COUNT,
+};
+
+struct screenData {
+    Window window;
+    Picture picture;
+    Picture pictures[DOTS_PICTURE_COUNT];
+    /* indicator positions relative to the window */
+    XPoint *indicators;
+    unsigned int count;
+};
+
+static struct moduleData {
+    Display *display;
+    struct screenData *screens;
+    char *colorname_input;
+    char *colorname_check;
+    char *colorname_error;
+    char *colorname_bg;
+    int size;
+    int max;
+    /* currently displayed state */
+    enum aInputState state;
+    unsigned int length;
+    unsigned int position;
+} data = { NULL, NULL, NULL, NULL, NULL, NULL, 12, 32, AINPUT_STATE_NONE, 0, 0 };
+
+
+static void module_loadargs(const char *args) {
+
+    if (!args || strstr(args, "dots:") != args)
+        return;
+
+    char *arguments = strdup(&args[5]);
+    char *arg;
+    char *tmp;
+
+    for (tmp = arguments; tmp; ) {
+        arg = strsep(&tmp, ",");
+        if (strstr(arg, "size=") == arg) {
+            data.size = strtol(&arg[5], NULL, 0);
+        }
+        else if (strstr(arg, "max=") == arg) {
+            data.max = strtol(&arg[4], NULL, 0);
+        }
+        else if (strstr(arg, "input=") == arg) {
+            free(data.colorname_input);
+            data.colorname_input = strdup(&arg[6]);
+        }
+        else if (strstr(arg, "check=") == arg) {
+            free(data.colorname_check);
+            data.colorname_check = strdup(&arg[6]);
+        }
+        else if (strstr(arg, "error=") == arg) {
+            free(data.colorname_error);
+            data.colorname_error = strdup(&arg[6]);
+        }
+        else if (strstr(arg, "bg=") == arg) {
+            free(data.colorname_bg);
+            data.colorname_bg = strdup(&arg[3]);
+        }
+    }
+
+    free(arguments);
+}
+
+static void module_loadxrdb(XrmDatabase xrdb) {
+
+    XrmValue value;
+    char *type;
+
+    if (XrmGetResource(xrdb, "alock.input.dots.size",
+                "ALock.Input.Dots.Size", &type, &value))
+        data.size = strtol(value.addr, NULL, 0);
+    if (XrmGetResource(xrdb, "alock.input.dots.max",
+                "ALock.Input.Dots.Max", &type, &value))
+        data.max = strtol(value.addr, NULL, 0);
+
+    if (XrmGetResource(xrdb, "alock.input.dots.color.input",
+                "ALock.Input.Dots.Color.Input", &type, &value))
+        data.colorname_input = strdup(value.addr);
+    if (XrmGetResource(xrdb, "alock.input.dots.color.check",
+                "ALock.Input.Dots.Color.Check", &type, &value))
+        data.colorname_check = strdup(value.addr);
+    if (XrmGetResource(xrdb, "alock.input.dots.color.error",
+                "ALock.Input.Dots.Color.Error", &type, &value))
+        data.colorname_error = strdup(value.addr);
+    if (XrmGetResource(xrdb, "alock.input.dots.color.background",
+                "ALock.Input.Dots.Color.Background", &type, &value))
+        data.colorname_bg = strdup(value.addr);
+
+}
+
+/* Get the distance between consecutive slots. */
+static int slot_step(void) {
+    return data.size + data.size / 2;
+}
+
+/* Get the geometry of the indicator window. */
+static void window_size(int *width, int *height) {
+    *width = data.max * slot_step() + data.size / 2;
+    *height = data.size * 2;
+}
+
+/* Get the geometry of monitors of the given screen. Without RandR (or if no
+ * CRTC is active) the whole screen is one monitor. This function returns the
+ * number of monitors, which have to be freed with free(). */
+static unsigned int screen_monitors(int i, int width, int height, XRectangle **monitors) {
+
+#if HAVE_XRANDR
+    Display *dpy = data.display;
+    XRRScreenResources *res;
+    unsigned int count = 0;
+    int event, error, c;
+
+    if (XRRQueryExtension(dpy, &event, &error) &&
+            (res = XRRGetScreenResourcesCurrent(dpy, RootWindow(dpy, i))) != NULL) {
+
+        if ((*monitors = malloc(sizeof(**monitors) * (res->ncrtc + 1))) != NULL)
+            for (c = 0; c < res->ncrtc; c++) {
+
+                XRRCrtcInfo *crtc;
+
+                if ((crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[c])) == NULL)
+                    continue;
+
+                if (crtc->mode != None && crtc->noutput > 0) {
+                    XRectangle *m = &(*monitors)[count++];
+                    m->x = crtc->x;
+                    m->y = crtc->y;
+                    m->width = crtc->width;
+                    m->height = crtc->height;
+                }
+
+                XRRFreeCrtcInfo(crtc);
+            }
+
+        XRRFreeScreenResources(res);
+
+        if (count > 0)
+            return count;
+        free(*monitors);
+
+    }
+#else
+    (void)i;
+#endif
+
+    if ((*monitors = malloc(sizeof(**monitors))) == NULL)
+        return 0;
+    (*monitors)[0].x = 0;
+    (*monitors)[0].y = 0;
+    (*monitors)[0].width = width;
+    (*monitors)[0].height = height;
+    return 1;
+}
+
+/* Place indicators in the center of every monitor of the given screen. The
+ * window covers all of them and it is shaped to the indicator areas. Without
+ * the shape extension, only the first monitor gets the indicator. */
+static void place_indicators(int i, struct screenData *sd, int width, int height) {
+
+    XRectangle *monitors = NULL;
+    int x0 = width, y0 = height, x1 = 0, y1 = 0;
+    int w, h, x, y;
+    unsigned int n;
+
+    window_size(&w, &h);
+
+    free(sd->indicators);
+    sd->indicators = NULL;
+    sd->count = screen_monitors(i, width, height, &monitors);
+#if !HAVE_XEXT
+    if (sd->count > 1)
+        sd->count = 1;
+#endif
+
+    if (sd->count > 0 && (sd->indicators = malloc(sizeof(*sd->indicators) * sd->count)) == NULL)
+        sd->count = 0;
+
+    for (n = 0; n < sd->count; n++) {
+        x = monitors[n].x + ((int)monitors[n].width - w) / 2;
+        y = monitors[n].y + ((int)monitors[n].height - h) / 2;
+        sd->indicators[n].x = x;
+        sd->indicators[n].y = y;
+        if (x < x0) x0 = x;
+        if (y < y0) y0 = y;
+        if (x + w > x1) x1 = x + w;
+        if (y + h > y1) y1 = y + h;
+        debug("indicator %d.%u: %dx%d+%d+%d", i, n, w, h, x, y);
+    }
+
+    free(monitors);
+
+    if (sd->count == 0) {
+        /* fall back to the center of the screen */
+        x0 = (width - w) / 2;
+        y0 = (height - h) / 2;
+        x1 = x0 + w;
+        y1 = y0 + h;
+    }
+
+    for (n = 0; n < sd->count; n++) {
+        sd->indicators[n].x -= x0;
+        sd->indicators[n].y -= y0;
+    }
+
+    XMoveResizeWindow(data.display, sd->window, x0, y0, x1 - x0, y1 - y0);
+
+#if HAVE_XEXT
+    XShapeCombineMask(data.display, sd->window, ShapeBounding, 0, 0, None, ShapeSet);
+    if (sd->count > 1) {
+        XRectangle *rects;
+        if ((rects = malloc(sizeof(*rects) * sd->count)) != NULL) {
+            for (n = 0; n < sd->count; n++) {
+                rects[n].x = sd->indicators[n].x;
+                rects[n].y = sd->indicators[n].y;
+                rects[n].width = w;
+                rects[n].height = h;
+            }
+            XShapeCombineRectangles(data.display, sd->window, ShapeBounding,
+                    0, 0, rects, sd->count, ShapeSet, Unsorted);
+            free(rects);
+        }
+    }
+#endif
+
+}
+
+/* Render slot graphics of the given color into a new picture. */
+static Picture create_picture(Screen *screen, XRenderPictFormat *format,
+        unsigned long bg, unsigned long fg, int dot, int cursor) {
+
+    Display *dpy = data.display;
+    Window root = RootWindowOfScreen(screen);
+    int step = slot_step();
+    XGCValues gcval;
+    Picture picture;
+    Pixmap pixmap;
+    GC gc;
+
+    pixmap = XCreatePixmap(dpy, root, step, data.size, DefaultDepthOfScreen(screen));
+
+    gcval.foreground = bg;
+    gc = XCreateGC(dpy, pixmap, GCForeground, &gcval);
+    XFillRectangle(dpy, pixmap, gc, 0, 0, step, data.size);
+
+    XSetForeground(dpy, gc, fg);
+    if (dot)
+        XFillArc(dpy, pixmap, gc, data.size / 2, 0, data.size, data.size, 0, 360 * 64);
+    else if (cursor)
+        XFillRectangle(dpy, pixmap, gc, data.size / 2, 0, data.size, data.size / 4 + 1);
+    else
+        /* empty slot is marked with a small point */
+        XFillArc(dpy, pixmap, gc, data.size / 2 + data.size * 3 / 8,
+                data.size * 3 / 8, data.size / 4 + 1, data.size / 4 + 1, 0, 360 * 64);
+
+    XFreeGC(dpy, gc);
+
+    picture = XRenderCreatePicture(dpy, pixmap, format, 0, NULL);
+    XFreePixmap(dpy, pixmap);
+
+    return picture;
+}
+
+/* Composite given slot picture into every indicator of the screen. The
+ * upper row contains dots, while the lower one the cursor. */
+static void draw_slot(struct screenData *sd, int slot, int row, enum dotsPicture picture) {
+    unsigned int n;
+    for (n = 0; n < sd->count; n++)
+        XRenderComposite(data.display, PictOpSrc, sd->pictures[picture], None, sd->picture,
+                0, 0, 0, 0, sd->indicators[n].x + slot * slot_step(),
+                sd->indicators[n].y + row * data.size, slot_step(), data.size);
+}
+
+static enum dotsPicture slot_picture(unsigned int slot) {
+
+    if (slot >= data.length)
+        return DOTS_PICTURE_EMPTY;
+
+    switch (data.state) {
+    case AINPUT_STATE_CHECK:
+    case AINPUT_STATE_VALID:
+        return DOTS_PICTURE_CHECK;
+    case AINPUT_STATE_ERROR:
+        return DOTS_PICTURE_ERROR;
+    default:
+        return DOTS_PICTURE_INPUT;
+    }
+
+}
+
+/* Draw all slots of the given screen. */
+static void draw_screen(struct screenData *sd) {
+
+    int slot;
+
+    for (slot = 0; slot < data.max; slot++) {
+        draw_slot(sd, slot, 0, slot_picture(slot));
+        draw_slot(sd, slot, 1, (unsigned int)slot == data.position ?
+                DOTS_PICTURE_CURSOR : DOTS_PICTURE_BLANK);
+    }
+
+}
+
+static int module_init(Display *dpy) {
+
+    XSetWindowAttributes xswa;
+    int width, height;
+    int i, p;
+
+    if (!alock_check_xrender(dpy))
+        return -1;
+
+    if (data.size < 2)
+        data.size = 2;
+    if (data.max < 1)
+        data.max = 1;
+
+    data.display = dpy;
+    if ((data.screens = (struct screenData *)calloc(ScreenCount(dpy), sizeof(*data.screens))) == NULL)
+        return -1;
+    window_size(&width, &height);
+
+    for (i = 0; i < ScreenCount(dpy); i++) {
+
+        struct screenData *sd = &data.screens[i];
+        Screen *screen = ScreenOfDisplay(dpy, i);
+        Colormap colormap = DefaultColormapOfScreen(screen);
+        XRenderPictFormat *format;
+        XColor input, check, error, bg;
+
+        alock_alloc_color(dpy, colormap, data.colorname_input, "green", &input);
+        alock_alloc_color(dpy, colormap, data.colorname_check, "yellow", &check);
+        alock_alloc_color(dpy, colormap, data.colorname_error, "red", &error);
+        alock_alloc_color(dpy, colormap, data.colorname_bg, "black", &bg);
+
+        xswa.override_redirect = True;
+        xswa.colormap = colormap;
+        xswa.background_pixel = bg.pixel;
+        sd->window = XCreateWindow(dpy, RootWindowOfScreen(screen),
+                (WidthOfScreen(screen) - width) / 2, (HeightOfScreen(screen) - height) / 2,
+                width, height, 0, CopyFromParent, InputOutput, CopyFromParent,
+                CWOverrideRedirect | CWColormap | CWBackPixel, &xswa);
+        place_indicators(i, sd, WidthOfScreen(screen), HeightOfScreen(screen));
+
+        format = XRenderFindVisualFormat(dpy, DefaultVisualOfScreen(screen));
+        sd->picture = XRenderCreatePicture(dpy, sd->window, format, 0, NULL);
+
+        sd->pictures[DOTS_PICTURE_EMPTY] = create_picture(screen, format, bg.pixel, input.pixel, 0, 0);
+        sd->pictures[DOTS_PICTURE_INPUT] = create_picture(screen, format, bg.pixel, input.pixel, 1, 0);
+        sd->pictures[DOTS_PICTURE_CHECK] = create_picture(screen, format, bg.pixel, check.pixel, 1, 0);
+        sd->pictures[DOTS_PICTURE_ERROR] = create_picture(screen, format, bg.pixel, error.pixel, 1, 0);
+        sd->pictures[DOTS_PICTURE_CURSOR] = create_picture(screen, format, bg.pixel, input.pixel, 0, 1);
+        sd->pictures[DOTS_PICTURE_BLANK] = create_picture(screen, format, bg.pixel, bg.pixel, 0, 1);
+
+        for (p = 0; p < DOTS_PICTURE_COUNT; p++)
+            if (sd->pictures[p] == None)
+                return -1;
+
+    }
+
+    return 0;
+}
+
+static void module_free(void) {
+
+    int i, p;
+
+    if (data.screens) {
+        /* initialization might have failed partway */
+        for (i = 0; i < ScreenCount(data.display); i++) {
+            for (p = 0; p < DOTS_PICTURE_COUNT; p++)
+                if (data.screens[i].pictures[p] != None)
+                    XRenderFreePicture(data.display, data.screens[i].pictures[p]);
+            if (data.screens[i].picture != None)
+                XRenderFreePicture(data.display, data.screens[i].picture);
+            if (data.screens[i].window != None)
+                XDestroyWindow(data.display, data.screens[i].window);
+            free(data.screens[i].indicators);
+        }
+        free(data.screens);
+        data.screens = NULL;
+    }
+
+    free(data.colorname_input);
+    data.colorname_input = NULL;
+    free(data.colorname_check);
+    data.colorname_check = NULL;
+    free(data.colorname_error);
+    data.colorname_error = NULL;
+    free(data.colorname_bg);
+    data.colorname_bg = NULL;
+
+}
+
+static Window module_getwindow(int screen) {
+    if (!data.screens)
+        return None;
+    return data.screens[screen].window;
+}
+
+static KeySym module_keypress(KeySym key) {
+    return key;
+}
+
+static void module_setstate(enum aInputState state) {
+    debug("setstate: %d", state);
+
+    Display *dpy = data.display;
+    int i;
+
+    data.state = state;
+
+    if (state == AINPUT_STATE_NONE) {
+        for (i = 0; i < ScreenCount(dpy); i++)
+            XUnmapWindow(dpy, data.screens[i].window);
+        return;
+    }
+    if (state == AINPUT_STATE_INIT) {
+        data.length = data.position = 0;
+        for (i = 0; i < ScreenCount(dpy); i++) {
+            XMapWindow(dpy, data.screens[i].window);
+            XRaiseWindow(dpy, data.screens[i].window);
+        }
+    }
+
+    /* state change affects all slots */
+    for (i = 0; i < ScreenCount(dpy); i++)
+        draw_screen(&data.screens[i]);
+    XFlush(dpy);
+
+    /* internal input penalty for error */
+    if (state == AINPUT_STATE_ERROR) {
+        sleep(1);
+        /* discard all pending events in the queue */
+        XSync(dpy, True);
+    }
+}
+
+static void module_expose(Window window, Region region) {
+    (void)region;
+
+    int i;
+
+    if (data.state == AINPUT_STATE_NONE)
+        return;
+
+    /* the window is small, so simply redraw it as a whole */
+    for (i = 0; i < ScreenCount(data.display); i++)
+        if (data.screens[i].window == window)
+            draw_screen(&data.screens[i]);
+
+}
+
+static void module_resize(int screen, int width, int height) {
+
+    struct screenData *sd = &data.screens[screen];
+
+    /* monitor layout might have changed as well */
+    place_indicators(screen, sd, width, height);
+
+    if (data.state != AINPUT_STATE_NONE)
+        draw_screen(sd);
+
+}
+
+static void module_update(unsigned int length, unsigned int position) {
+
+    unsigned int max = data.max;
+    unsigned int old_length = data.length;
+    unsigned int old_position = data.position;
+    unsigned int slot;
+    int i;
+
+    if (length > max)
+        length = max;
+    if (position > max - 1)
+        position = max - 1;
+
+    data.length = length;
+    data.position = position;
+
+    /* redraw changed slots only */
+    for (i = 0; i < ScreenCount(data.display); i++) {
+        struct screenData *sd = &data.screens[i];
+        for (slot = length < old_length ? length : old_length;
+                slot < (length > old_length ? length : old_length); slot++)
+            draw_slot(sd, slot, 0, slot_picture(slot));
+        if (position != old_position) {
+            draw_slot(sd, old_position, 1, DOTS_PICTURE_BLANK);
+            draw_slot(sd, position, 1, DOTS_PICTURE_CURSOR);
+        }
+    }
+
+}
+
+
+struct aModuleInput alock_input_dots = {
+    {  "dots",
+        module_loadargs,
+        module_loadxrdb,
+        module_init,
+        module_free,
+    },
+    module_getwindow,
+    module_keypress,
+    module_setstate,
+    module_expose,
+    module_resize,
+    module_update,
+};
@@ -41,7 +41,13 @@ static struct moduleData {
     struct colorPixel color_check;
     struct colorPixel color_error;
     int width;
-} data = { NULL, None, { 0 }, { 0 }, { 0 }, 10 };
+    /* geometry of the screen */
+    int screen_width;
+    int screen_height;
+    /* graphics context for every input state */
+    GC gc[AINPUT_STATE_ERROR + 1];
+    enum aInputState state;
+} data = { NULL, None, { 0 }, { 0 }, { 0 }, 10, 0, 0, { 0 }, AINPUT_STATE_NONE };
 
 
 static void module_loadargs(const char *args) {
@@ -96,6 +102,20 @@ static void module_loadxrdb(XrmDatabase xrdb) {
 
 }
 
+/* Cut out the inner part of the window, so only the frame is visible. */
+static void shape_window(void) {
+#if HAVE_XEXT
+    XRectangle rect = {
+        0, 0,
+        data.screen_width - 2 * data.width,
+        data.screen_height - 2 * data.width,
+    };
+    XShapeCombineMask(data.display, data.window, ShapeBounding, 0, 0, None, ShapeSet);
+    XShapeCombineRectangles(data.display, data.window, ShapeBounding,
+            data.width, data.width, &rect, 1, ShapeSubtract, 0);
+#endif
+}
+
 static int module_init(Display *dpy) {
 
     Screen *screen = DefaultScreenOfDisplay(dpy);
@@ -104,11 +124,13 @@ static int module_init(Display *dpy) {
     XColor color;
 
     data.display = dpy;
+    data.screen_width = WidthOfScreen(screen);
+    data.screen_height = HeightOfScreen(screen);
 
     xswa.override_redirect = True;
     xswa.colormap = colormap;
     data.window = XCreateWindow(dpy, RootWindowOfScreen(screen),
-            0, 0, WidthOfScreen(screen), HeightOfScreen(screen), 0,
+            0, 0, data.screen_width, data.screen_height, 0,
             CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect | CWColormap, &xswa);
 
     debug("selected colors: `%s`, `%s`, `%s`", data.color_input.name,
@@ -120,21 +142,27 @@ static int module_init(Display *dpy) {
     alock_alloc_color(dpy, colormap, data.color_error.name, "red", &color);
     data.color_error.pixel = color.pixel;
 
-#if HAVE_XEXT
-    XRectangle rect = {
-        0, 0,
-        WidthOfScreen(screen) - 2 * data.width,
-        HeightOfScreen(screen) - 2 * data.width,
-    };
-    XShapeCombineRectangles(dpy, data.window, ShapeBounding,
-            data.width, data.width, &rect, 1, ShapeSubtract, 0);
-#endif
+    data.gc[AINPUT_STATE_NONE] = XCreateGC(dpy, data.window, 0, NULL);
+    XSetForeground(dpy, data.gc[AINPUT_STATE_NONE], data.color_input.pixel);
+    data.gc[AINPUT_STATE_INIT] = data.gc[AINPUT_STATE_NONE];
+    data.gc[AINPUT_STATE_VALID] = data.gc[AINPUT_STATE_NONE];
+    data.gc[AINPUT_STATE_CHECK] = XCreateGC(dpy, data.window, 0, NULL);
+    XSetForeground(dpy, data.gc[AINPUT_STATE_CHECK], data.color_check.pixel);
+    data.gc[AINPUT_STATE_ERROR] = XCreateGC(dpy, data.window, 0, NULL);
+    XSetForeground(dpy, data.gc[AINPUT_STATE_ERROR], data.color_error.pixel);
+
+    shape_window();
 
     return 0;
 }
 
 static void module_free(void) {
 
+    XFreeGC(data.display, data.gc[AINPUT_STATE_NONE]);
+    XFreeGC(data.display, data.gc[AINPUT_STATE_CHECK]);
+    XFreeGC(data.display, data.gc[AINPUT_STATE_ERROR]);
+    memset(data.gc, 0, sizeof(data.gc));
+
     XDestroyWindow(data.display, data.window);
 
     free(data.color_input.name);
@@ -166,12 +194,25 @@ static KeySym module_keypress(KeySym key) {
     return key;
 }
 
+/* Draw the frame with the graphics context of the current state. */
+static void draw_frame(GC gc) {
+
+    int width = data.screen_width;
+    int height = data.screen_height;
+
+    XFillRectangle(data.display, data.window, gc, 0, 0, width, data.width);
+    XFillRectangle(data.display, data.window, gc, 0, 0, data.width, height);
+    XFillRectangle(data.display, data.window, gc, 0, height - data.width, width, data.width);
+    XFillRectangle(data.display, data.window, gc, width - data.width, 0, data.width, height);
+
+}
+
 static void module_setstate(enum aInputState state) {
     debug("setstate: %d", state);
 
     Display *dpy = data.display;
-    XGCValues gcvals;
-    int height, width;
+
+    data.state = state;
 
     if (state == AINPUT_STATE_NONE) {
         /* hide input frame indicator */
@@ -184,28 +225,7 @@ static void module_setstate(enum aInputState state) {
         XRaiseWindow(dpy, data.window);
     }
 
-    switch (state) {
-    case AINPUT_STATE_CHECK:
-        gcvals.foreground = data.color_check.pixel;
-        break;
-    case AINPUT_STATE_ERROR:
-        gcvals.foreground = data.color_error.pixel;
-        break;
-    default:
-        gcvals.foreground = data.color_input.pixel;
-    }
-
-    Screen *screen = DefaultScreenOfDisplay(dpy);
-    width = WidthOfScreen(screen);
-    height = HeightOfScreen(screen);
-
-    GC gc = XCreateGC(dpy, data.window, 0, 0);
-    XChangeGC(dpy, gc, GCForeground, &gcvals);
-    XFillRectangle(dpy, data.window, gc, 0, 0, width, data.width);
-    XFillRectangle(dpy, data.window, gc, 0, 0, data.width, height);
-    XFillRectangle(dpy, data.window, gc, 0, height - data.width, width, data.width);
-    XFillRectangle(dpy, data.window, gc, width - data.width, 0, data.width, height);
-    XFreeGC(dpy, gc);
+    draw_frame(data.gc[state]);
     XFlush(dpy);
 
     /* internal input penalty for error */
@@ -216,6 +236,36 @@ static void module_setstate(enum aInputState state) {
     }
 }
 
+static void module_expose(Window window, Region region) {
+
+    GC gc = data.gc[data.state];
+
+    if (window != data.window || data.state == AINPUT_STATE_NONE)
+        return;
+
+    /* repaint exposed part of the frame only */
+    XSetRegion(data.display, gc, region);
+    draw_frame(gc);
+    XSetClipMask(data.display, gc, None);
+
+}
+
+static void module_resize(int screen, int width, int height) {
+
+    if (screen != DefaultScreen(data.display))
+        return;
+
+    data.screen_width = width;
+    data.screen_height = height;
+
+    XResizeWindow(data.display, data.window, width, height);
+    shape_window();
+
+    if (data.state != AINPUT_STATE_NONE)
+        draw_frame(data.gc[data.state]);
+
+}
+
 
 struct aModuleInput alock_input_frame = {
     {  "frame",
@@ -227,4 +277,7 @@ struct aModuleInput alock_input_frame = {
     module_getwindow,
     module_keypress,
     module_setstate,
+    module_expose,
+    module_resize,
+    NULL,
 };
@@ -40,4 +40,7 @@ struct aModuleInput alock_input_none = {
     module_getwindow,
     module_keypress,
     module_setstate,
+    NULL,
+    NULL,
+    NULL,
 };
@@ -12,8 +12,18 @@
 #include "alock.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#if ENABLE_PLUGINS
+# include <dlfcn.h>
+# include <glob.h>
+# include <limits.h>
+#endif
 #include <locale.h>
+#include <poll.h>
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
 #include <signal.h>
 #include <spawn.h>
 #include <stdlib.h>
@@ -32,6 +42,7 @@
 extern char **environ;
 
 static struct aModuleAuth *alock_modules_auth[] = {
+#if !ENABLE_PLUGINS
 #if ENABLE_PAM
     &alock_auth_pam,
 #endif
@@ -41,18 +52,19 @@ static struct aModuleAuth *alock_modules_auth[] = {
 #if ENABLE_HASH
     &alock_auth_hash,
 #endif
+#endif /* !ENABLE_PLUGINS */
     &alock_auth_none,
     NULL
 };
 
 static struct aModuleBackground *alock_modules_background[] = {
     &alock_bg_blank,
-#if ENABLE_IMLIB2
+#if !ENABLE_PLUGINS
     &alock_bg_image,
-#endif
 #if ENABLE_XRENDER
     &alock_bg_shade,
 #endif
+#endif /* !ENABLE_PLUGINS */
     &alock_bg_none,
     NULL
 };
@@ -61,7 +73,7 @@ static struct aModuleCursor *alock_modules_cursor[] = {
     &alock_cursor_none,
     &alock_cursor_blank,
     &alock_cursor_glyph,
-#if ENABLE_XCURSOR
+#if ENABLE_XCURSOR && !ENABLE_PLUGINS
     &alock_cursor_xcursor,
 #if (ENABLE_XRENDER && (ENABLE_XPM || ENABLE_IMLIB2))
     &alock_cursor_image,
@@ -72,10 +84,292 @@ static struct aModuleCursor *alock_modules_cursor[] = {
 
 static struct aModuleInput *alock_modules_input[] = {
     &alock_input_frame,
+#if ENABLE_XRENDER && !ENABLE_PLUGINS
+    &alock_input_dots,
+#endif
     &alock_input_none,
     NULL
 };
 
+static struct aModuleOverlay *alock_modules_overlay[] = {
+    &alock_overlay_none,
+#if ENABLE_XRENDER && !ENABLE_PLUGINS
+    &alock_overlay_status,
+#endif
+    NULL
+};
+
+/* Minimal interval (in milliseconds) between input indicator updates, which
+ * corresponds to the refresh rate of a typical display. */
+#define ALOCK_UPDATE_INTERVAL 16
+
+/* Idle time (in milliseconds) after which the entered password is verified
+ * speculatively. If set to 0, speculative verification is disabled. */
+static unsigned int alock_speculate_delay = 0;
+
+/* speculative verification worker */
+struct aSpeculation {
+#if ENABLE_THREADS
+    pthread_t thread;
+#endif
+    struct aModuleAuth *auth;
+    /* worker thread has been started and not joined yet */
+    int active;
+    /* result is awaited for the input buffer generation */
+    int valid;
+    unsigned int generation;
+    int finished;
+    int done;
+    int result;
+    char pass[128 * sizeof(wchar_t)];
+};
+
+/* The worker is not waited for when its result is not needed any more, so
+ * the state has to outlive the event loop. */
+static struct aSpeculation speculation = { 0 };
+
+#if ENABLE_PLUGINS
+/* Default authentication module, which shall be used when the user has not
+ * specified any. It is the same module as for the monolithic build. */
+static const char *alock_plugins_auth_default =
+#if ENABLE_PAM
+    "pam";
+#elif ENABLE_PASSWD
+    "passwd";
+#elif ENABLE_HASH
+    "hash";
+#else
+    NULL;
+#endif
+
+/* handles of loaded plug-ins */
+static void *alock_plugins[8];
+static unsigned int alock_plugins_count = 0;
+#endif /* ENABLE_PLUGINS */
+
+
+#if ENABLE_PLUGINS
+/* Load module from the plug-in directory. The module is located by its type
+ * and the name, which is a leading part of the given module arguments (up to
+ * the first colon character), e.g. "bg" and "image:file=a.png" resolves into
+ * the "bg_image.so" plug-in, which shall export "alock_bg_image" symbol. This
+ * function returns the pointer to the module structure or NULL on error. */
+static void *loadPlugin(const char *type, const char *args) {
+
+    char path[PATH_MAX];
+    char symbol[64];
+    void *handle;
+    void *module;
+    size_t len;
+
+    if (args == NULL)
+        return NULL;
+
+    /* Plug-in name is used to construct the path of the shared object. We
+     * might be running with elevated privileges, so do not allow anything
+     * fancy, e.g. "../". */
+    len = strspn(args, "abcdefghijklmnopqrstuvwxyz0123456789");
+    if (len == 0 || len > 32 || (args[len] != '\0' && args[len] != ':'))
+        return NULL;
+
+    if (alock_plugins_count == sizeof(alock_plugins) / sizeof(*alock_plugins))
+        return NULL;
+
+    snprintf(path, sizeof(path), "%s/%s_%.*s.so", ALOCK_PLUGINDIR, type, (int)len, args);
+    snprintf(symbol, sizeof(symbol), "alock_%s_%.*s", type, (int)len, args);
+
+    debug("loading plug-in: %s", path);
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        debug("plug-in load failed: %s", dlerror());
+        return NULL;
+    }
+
+    if ((module = dlsym(handle, symbol)) == NULL) {
+        fprintf(stderr, "alock: invalid plug-in `%s`: %s\n", path, dlerror());
+        dlclose(handle);
+        return NULL;
+    }
+
+    alock_plugins[alock_plugins_count++] = handle;
+    return module;
+}
+#endif /* ENABLE_PLUGINS */
+
+#if ENABLE_PLUGINS
+/* Unload all previously loaded plug-ins. */
+static void unloadPlugins(void) {
+    while (alock_plugins_count)
+        dlclose(alock_plugins[--alock_plugins_count]);
+}
+#endif /* ENABLE_PLUGINS */
+
+#if ENABLE_PLUGINS
+/* Print names of all available plug-ins of the given type. */
+static void listPlugins(const char *type) {
+
+    char pattern[PATH_MAX];
+    glob_t pglob;
+    size_t i;
+
+    snprintf(pattern, sizeof(pattern), "%s/%s_*.so", ALOCK_PLUGINDIR, type);
+    if (glob(pattern, 0, NULL, &pglob) != 0)
+        return;
+
+    for (i = 0; i < pglob.gl_pathc; i++) {
+        const char *name = strrchr(pglob.gl_pathv[i], '/') + strlen(type) + 2;
+        printf("  %.*s\n", (int)(strlen(name) - 3), name);
+    }
+
+    globfree(&pglob);
+}
+#endif /* ENABLE_PLUGINS */
+
+/* Split the chain of authentication modules, e.g. "hash:...+pam", in-place.
+ * The '+' character (or the backslash) which is a part of module options has
+ * to be escaped with the backslash. This function returns the number of
+ * modules, or -1 if there are more than the given size. */
+static int splitAuthChain(char *str, char **tokens, int size) {
+
+    char *r = str, *w = str;
+    int count = 1;
+
+    tokens[0] = str;
+    while (*r != '\0') {
+        if (*r == '\\' && (r[1] == '+' || r[1] == '\\')) {
+            *w++ = r[1];
+            r += 2;
+        }
+        else if (*r == '+') {
+            if (count == size)
+                return -1;
+            *w++ = '\0';
+            tokens[count++] = w;
+            r++;
+        }
+        else
+            *w++ = *r++;
+    }
+
+    *w = '\0';
+    return count;
+}
+
+/* Find authentication module by the leading part of the given arguments. If
+ * such a module is not compiled in, try to load it from the plug-in. */
+static struct aModuleAuth *findAuthModule(const char *args) {
+
+    struct aModuleAuth **i;
+    for (i = alock_modules_auth; *i; ++i)
+        if (strstr(args, (*i)->m.name) == args)
+            return *i;
+
+#if ENABLE_PLUGINS
+    return loadPlugin("auth", args);
+#else
+    return NULL;
+#endif
+}
+
+#if ENABLE_THREADS
+static void *speculationWorker(void *arg) {
+
+    struct aSpeculation *spec = (struct aSpeculation *)arg;
+    int result;
+
+    result = spec->auth->verify(spec->pass);
+    memset(spec->pass, 0, sizeof(spec->pass));
+
+    spec->result = result;
+    __atomic_store_n(&spec->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+#endif
+
+/* Start speculative verification of the given password. Verification is
+ * performed in the worker thread. Verification callbacks might be run
+ * concurrently with the authentication, but not with themselves, so only one
+ * worker is run at a time. If the previous (discarded) one has not finished
+ * yet, this function does nothing and it shall be called again later. */
+static void speculationStart(struct aSpeculation *spec, struct aModuleAuth *auth,
+        const char *pass, unsigned int generation) {
+#if ENABLE_THREADS
+
+    if (spec->active)
+        return;
+
+    spec->auth = auth;
+    spec->finished = 0;
+    strncpy(spec->pass, pass, sizeof(spec->pass));
+    spec->pass[sizeof(spec->pass) - 1] = '\0';
+
+    if ((errno = pthread_create(&spec->thread, NULL, speculationWorker, spec)) != 0) {
+        perror("alock: speculation thread failed");
+        memset(spec->pass, 0, sizeof(spec->pass));
+        return;
+    }
+
+    debug("speculative verification started: %u", generation);
+    spec->active = 1;
+    spec->valid = 1;
+    spec->generation = generation;
+    spec->done = 0;
+
+#else
+    (void)spec;
+    (void)auth;
+    (void)pass;
+    (void)generation;
+#endif
+}
+
+/* Check whether the speculative verification has finished. If the wait flag
+ * is set, this function blocks until the worker (also a discarded one) is
+ * done, so it is safe to free the authentication module afterwards. */
+static void speculationPoll(struct aSpeculation *spec, int wait) {
+#if ENABLE_THREADS
+
+    if (!spec->active)
+        return;
+
+    if (!wait && !__atomic_load_n(&spec->finished, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_join(spec->thread, NULL);
+    spec->active = 0;
+
+    if (spec->valid) {
+        spec->done = 1;
+        debug("speculative verification result: %d", spec->result);
+    }
+
+#else
+    (void)spec;
+    (void)wait;
+#endif
+}
+
+/* Discard the result of the speculative verification (if any). The worker
+ * can not be interrupted, so it is left running until it finishes. */
+static void speculationCancel(struct aSpeculation *spec) {
+    spec->valid = 0;
+    spec->done = 0;
+}
+
+/* Refresh overlay content. This function returns the time of the next
+ * refresh or 0 if there is no need to refresh the overlay again. */
+static unsigned long overlayRefresh(struct aModuleOverlay *overlay) {
+
+    long delay;
+    int trace;
+
+    trace = alock_trace_begin("overlay.refresh", overlay->m.name);
+    delay = overlay->refresh();
+    alock_trace_end(trace);
+
+    if (delay == -1)
+        return 0;
+    return alock_mtime() + delay;
+}
 
 /* Register alock instance. This function returns 0 on success or -1 when
  * another instance is already registered. Note, that this function does
@@ -180,6 +474,8 @@ static int lockDisplay(Display *display, struct aModules *modules) {
 
     Window window;
     Cursor cursor;
+    int trace;
+    int rv;
     int i;
 
     for (i = 0; i < ScreenCount(display); i++) {
@@ -189,8 +485,16 @@ static int lockDisplay(Display *display, struct aModules *modules) {
 
             Window window_input;
 
-            if ((window_input = modules->input->getwindow(i)) != None)
-                XReparentWindow(display, window_input, window, 0, 0);
+            if ((window_input = modules->input->getwindow(i)) != None) {
+                XWindowAttributes xwa;
+                /* keep the position chosen by the input module */
+                XGetWindowAttributes(display, window_input, &xwa);
+                XReparentWindow(display, window_input, window, xwa.x, xwa.y);
+                /* background window is refilled by the server, however the
+                 * input one has to be repainted by its module */
+                if (modules->input->expose != NULL)
+                    XSelectInput(display, window_input, ExposureMask);
+            }
 
             XMapWindow(display, window);
             XRaiseWindow(display, window);
@@ -205,29 +509,41 @@ static int lockDisplay(Display *display, struct aModules *modules) {
     window = DefaultRootWindow(display);
     cursor = modules->cursor->getcursor();
 
-    if (XGrabPointer(display, window, False, None, GrabModeAsync, GrabModeAsync, None,
-                cursor, CurrentTime) != GrabSuccess) {
+    trace = alock_trace_begin("grab.pointer", NULL);
+    rv = XGrabPointer(display, window, False, None, GrabModeAsync, GrabModeAsync, None,
+            cursor, CurrentTime);
+    alock_trace_end(trace);
+
+    if (rv != GrabSuccess) {
         fprintf(stderr, "error: grab pointer failed\n");
         return -1;
     }
 
     /* try to grab 2 times, another process (windowmanager) may have grabbed
      * the keyboard already */
-    if (XGrabKeyboard(display, window, True, GrabModeAsync, GrabModeAsync,
-                CurrentTime) != GrabSuccess) {
-        sleep(1);
-        if (XGrabKeyboard(display, window, True, GrabModeAsync, GrabModeAsync,
-                    CurrentTime) != GrabSuccess) {
-            fprintf(stderr, "error: grab keyboard failed\n");
-            return -1;
-        }
+    for (i = 0; i < 2; i++) {
+
+        if (i > 0)
+            sleep(1);
+
+        trace = alock_trace_begin("grab.keyboard", NULL);
+        rv = XGrabKeyboard(display, window, True, GrabModeAsync, GrabModeAsync,
+                CurrentTime);
+        alock_trace_end(trace);
+
+        if (rv == GrabSuccess)
+            return 0;
+
     }
 
-    return 0;
+    fprintf(stderr, "error: grab keyboard failed\n");
+    return -1;
 }
 
 static void eventLoop(Display *display, struct aModules *modules) {
 
+    const long mask = KeyPressMask | StructureNotifyMask | ExposureMask;
+    Window window;
     XEvent ev;
     KeySym ks;
     char cbuf[10];
@@ -235,25 +551,89 @@ static void eventLoop(Display *display, struct aModules *modules) {
     unsigned int clen;
     unsigned int pass_pos = 0, pass_len = 0;
     unsigned long keypress_time = 0;
+    /* incremented upon every input buffer modification */
+    unsigned int pass_generation = 0;
+    struct aSpeculation *spec = &speculation;
+    /* pending input indicator update */
+    unsigned long update_time = 0;
+    int update = 0;
+    /* time of the next overlay refresh (0 if not scheduled) */
+    unsigned long overlay_time;
 
     /* if possible do not page this address to the swap area */
     mlock(pass, sizeof(pass));
+    mlock(spec, sizeof(*spec));
+
+    overlay_time = overlayRefresh(modules->overlay);
 
     debug("entering event main loop");
     for (;;) {
 
+        /* refresh overlay content on its own schedule */
+        if (overlay_time && alock_mtime() >= overlay_time)
+            overlay_time = overlayRefresh(modules->overlay);
+
         if (keypress_time) {
             /* check for any key press event (or root window state change) */
-            if (XCheckMaskEvent(display, KeyPressMask | StructureNotifyMask, &ev) == False) {
+            if (XCheckMaskEvent(display, mask, &ev) == False) {
+
+                struct pollfd pfd = { ConnectionNumber(display), POLLIN, 0 };
+                unsigned long now = alock_mtime();
+                long timeout;
+
+                /* All queued events have been processed, so update the input
+                 * indicator with the final state of the buffer. Key bursts
+                 * (e.g. autorepeat) are coalesced into one update per frame. */
+                if (update && modules->input->update != NULL &&
+                        now - update_time >= ALOCK_UPDATE_INTERVAL) {
+                    modules->input->update(pass_len, pass_pos);
+                    update_time = now;
+                    update = 0;
+                }
 
                 /* user fell asleep while typing (5 seconds inactivity) */
-                if (alock_mtime() - keypress_time > 5000) {
+                if (now - keypress_time > 5000) {
                     modules->input->setstate(AINPUT_STATE_NONE);
+                    speculationCancel(spec);
                     keypress_time = 0;
                 }
 
-                /* wait a bit */
-                usleep(25000);
+                /* user paused typing, verify entered password in advance */
+                else if (alock_speculate_delay && modules->auth->verify != NULL &&
+                        pass_len > 0 && (!spec->valid || spec->generation != pass_generation) &&
+                        now - keypress_time > alock_speculate_delay) {
+
+                    char rbuf[sizeof(pass)];
+
+                    speculationCancel(spec);
+                    wcstombs(rbuf, pass, sizeof(rbuf));
+                    speculationStart(spec, modules->auth, rbuf, pass_generation);
+                    memset(rbuf, 0, sizeof(rbuf));
+
+                }
+
+                speculationPoll(spec, 0);
+
+                if (!keypress_time)
+                    continue;
+
+                /* wait for the next event or for the nearest deadline */
+                timeout = 5000 - (now - keypress_time);
+                if (alock_speculate_delay && !spec->valid && pass_len > 0 &&
+                        now - keypress_time <= alock_speculate_delay)
+                    timeout = alock_speculate_delay - (now - keypress_time) + 1;
+                if (spec->active && timeout > 25)
+                    timeout = 25;
+                if (update && modules->input->update != NULL &&
+                        timeout > ALOCK_UPDATE_INTERVAL - (long)(now - update_time))
+                    timeout = ALOCK_UPDATE_INTERVAL - (now - update_time);
+                if (overlay_time && timeout > (long)(overlay_time - now))
+                    timeout = overlay_time - now;
+                if (timeout < 0)
+                    timeout = 0;
+
+                XFlush(display);
+                poll(&pfd, 1, timeout + 1);
                 continue;
             }
         }
@@ -265,8 +645,16 @@ static void eventLoop(Display *display, struct aModules *modules) {
                 setBacklightBrightness(0);
 #endif /* WITH_XBLIGHT */
 
-            /* block until any key press event arrives */
-            XMaskEvent(display, KeyPressMask | StructureNotifyMask, &ev);
+            /* Block until any key press event arrives. The only exception is
+             * the overlay refresh, which follows its own schedule, so there
+             * are no extra wake-ups. */
+            while (XCheckMaskEvent(display, mask, &ev) == False) {
+                struct pollfd pfd = { ConnectionNumber(display), POLLIN, 0 };
+                if (overlay_time && alock_mtime() >= overlay_time)
+                    overlay_time = overlayRefresh(modules->overlay);
+                XFlush(display);
+                poll(&pfd, 1, overlay_time ? (long)(overlay_time - alock_mtime()) + 1 : -1);
+            }
 
 #if WITH_XBLIGHT
             /* restore original backlight brightness value */
@@ -284,6 +672,7 @@ static void eventLoop(Display *display, struct aModules *modules) {
                 keypress_time = alock_mtime();
                 pass_pos = pass_len = 0;
                 pass[0] = '\0';
+                pass_generation++;
                 break;
             }
 
@@ -318,6 +707,7 @@ static void eventLoop(Display *display, struct aModules *modules) {
             case XK_Clear:
                 pass_pos = pass_len = 0;
                 pass[0] = '\0';
+                pass_generation++;
                 break;
 
             /* input position navigation */
@@ -342,6 +732,7 @@ static void eventLoop(Display *display, struct aModules *modules) {
                 if (pass_pos < pass_len) {
                     wmemmove(&pass[pass_pos], &pass[pass_pos + 1], pass_len - pass_pos);
                     pass_len--;
+                    pass_generation++;
                 }
                 break;
             case XK_BackSpace:
@@ -349,6 +740,7 @@ static void eventLoop(Display *display, struct aModules *modules) {
                     wmemmove(&pass[pass_pos - 1], &pass[pass_pos], pass_len - pass_pos + 1);
                     pass_pos--;
                     pass_len--;
+                    pass_generation++;
                 }
                 break;
 
@@ -358,18 +750,42 @@ static void eventLoop(Display *display, struct aModules *modules) {
             case XK_Return: {
 
                 char rbuf[sizeof(pass)];
+                int trace;
                 int rv;
 
                 modules->input->setstate(AINPUT_STATE_CHECK);
 
-                wcstombs(rbuf, pass, sizeof(rbuf));
-                rv = modules->auth->authenticate(rbuf);
+                rv = -1;
+                /* Use the result of the speculation, if the input has not
+                 * been modified in the meantime - the worker is verifying
+                 * this very password, so wait for it. A discarded worker is
+                 * not waited for, because the verification is allowed to
+                 * run concurrently with the authentication. */
+                if (spec->valid && spec->generation == pass_generation) {
+                    trace = alock_trace_begin("auth.speculation", modules->auth->m.name);
+                    speculationPoll(spec, 1);
+                    alock_trace_end(trace);
+                    if (spec->done)
+                        rv = spec->result;
+                }
+                speculationCancel(spec);
+
+                /* Speculative failure is not authoritative and it is not
+                 * reported - verify the password the regular way. */
+                if (rv != 0) {
+                    wcstombs(rbuf, pass, sizeof(rbuf));
+                    trace = alock_trace_begin("auth.authenticate", modules->auth->m.name);
+                    rv = modules->auth->authenticate(rbuf);
+                    alock_trace_end(trace);
+                }
 
                 memset(rbuf, 0, sizeof(rbuf));
                 memset(pass, 0, sizeof(pass));
                 pass_pos = pass_len = 0;
+                pass_generation++;
 
                 if (rv == 0) { /* successful authentication */
+                    alock_trace_mark("unlock", NULL);
                     modules->input->setstate(AINPUT_STATE_VALID);
                     return;
                 }
@@ -388,25 +804,71 @@ static void eventLoop(Display *display, struct aModules *modules) {
                     mbtowc(&pass[pass_pos], cbuf, clen);
                     pass_pos++;
                     pass_len++;
+                    pass_generation++;
                 }
                 break;
             }
 
+            update = 1;
+
+            /* input has been modified, speculation is not valid any more */
+            if (spec->valid && spec->generation != pass_generation)
+                speculationCancel(spec);
+
             debug("entered phrase [%zu]: `%ls`", wcslen(pass), pass);
             break;
 
-        case ConfigureNotify:
+        case ConfigureNotify: {
             /* NOTE: This event should be generated for the root window upon
              *       the display reconfiguration (e.g. resolution change). */
 
-            debug("received configure notify event");
+            XConfigureEvent *xce = &ev.xconfigure;
+            int i;
+
+            debug("received configure notify event: %dx%d", xce->width, xce->height);
+
+            for (i = 0; i < ScreenCount(display); i++)
+                if (RootWindow(display, i) == xce->window)
+                    break;
+            if (i == ScreenCount(display))
+                break;
+
+            /* Make sure, that the whole screen is covered as soon as possible.
+             * Modules might refine the content afterwards. */
+            if (modules->background->resize != NULL)
+                modules->background->resize(i, xce->width, xce->height);
+            else if ((window = modules->background->getwindow(i)) != None)
+                XResizeWindow(display, window, xce->width, xce->height);
+            if (modules->input->resize != NULL)
+                modules->input->resize(i, xce->width, xce->height);
+
+            XFlush(display);
             break;
+        }
+
+        case Expose: {
+
+            Region region = XCreateRegion();
+            XRectangle rect;
+
+            window = ev.xexpose.window;
+            /* merge all pending exposures of this window into one region,
+             * so the window is repainted only once */
+            do {
+                rect.x = ev.xexpose.x;
+                rect.y = ev.xexpose.y;
+                rect.width = ev.xexpose.width;
+                rect.height = ev.xexpose.height;
+                XUnionRectWithRegion(&rect, region, region);
+            } while (XCheckTypedWindowEvent(display, window, Expose, &ev));
 
-#if 0
-        case Expose:
-            XClearWindow(dpy, ((XExposeEvent*)&ev)->window);
+            if (modules->input->expose != NULL)
+                modules->input->expose(window, region);
+            modules->overlay->expose(window, region);
+
+            XDestroyRegion(region);
             break;
-#endif
+        }
 
         }
     }
@@ -422,34 +884,45 @@ int main(int argc, char **argv) {
         {"bg", required_argument, NULL, 'b'},
         {"cursor", required_argument, NULL, 'c'},
         {"input", required_argument, NULL, 'i'},
+        {"overlay", required_argument, NULL, 'o'},
+        {"trace", optional_argument, NULL, 't'},
+        {"speculate", optional_argument, NULL, 's'},
         {0, 0, 0, 0},
     };
 
     Display *display;
     struct aModules modules;
     int retval;
+    int trace;
+
+    const char *trace_file = NULL;
+    int trace_enabled = 0;
 
     const char *args_auth = NULL;
     const char *args_background = NULL;
     const char *args_cursor = NULL;
     const char *args_input = NULL;
+    const char *args_overlay = NULL;
 
     /* set-up default modules */
     modules.auth = alock_modules_auth[0];
     modules.background = alock_modules_background[0];
     modules.cursor = alock_modules_cursor[0];
     modules.input = alock_modules_input[0];
+    modules.overlay = alock_modules_overlay[0];
 
 #if WITH_XBLIGHT
     modules.backlight = -1;
 #endif
 
     /* parse options */
-    while ((opt = getopt_long_only(argc, argv, "hma:b:c:i:", longopts, NULL)) != -1)
+    while ((opt = getopt_long_only(argc, argv, "hma:b:c:i:o:t::s::", longopts, NULL)) != -1)
         switch (opt) {
         case 'h':
-            printf("%s [-help] [-modules] [-auth type:options] [-bg type:options]"
-                    " [-cursor type:options] [-input type:options]\n", argv[0]);
+            printf("%s [-help] [-modules] [-auth type:options[+type:options]] [-bg type:options]"
+                    " [-cursor type:options] [-input type:options] [-overlay type:options]"
+                    " [-trace[=file]]"
+                    " [-speculate[=ms]]\n", argv[0]);
             return EXIT_SUCCESS;
 
         case 'm': { /* list available modules */
@@ -458,41 +931,93 @@ int main(int argc, char **argv) {
             struct aModuleBackground **ib;
             struct aModuleCursor **ic;
             struct aModuleInput **ii;
+            struct aModuleOverlay **io;
 
             printf("authentication modules:\n");
             for (ia = alock_modules_auth; *ia; ++ia)
                 printf("  %s\n", (*ia)->m.name);
+#if ENABLE_PLUGINS
+            listPlugins("auth");
+#endif
 
             printf("background modules:\n");
             for (ib = alock_modules_background; *ib; ++ib)
                 printf("  %s\n", (*ib)->m.name);
+#if ENABLE_PLUGINS
+            listPlugins("bg");
+#endif
 
             printf("cursor modules:\n");
             for (ic = alock_modules_cursor; *ic; ++ic)
                 printf("  %s\n", (*ic)->m.name);
+#if ENABLE_PLUGINS
+            listPlugins("cursor");
+#endif
 
             printf("input modules:\n");
             for (ii = alock_modules_input; *ii; ++ii)
                 printf("  %s\n", (*ii)->m.name);
+#if ENABLE_PLUGINS
+            listPlugins("input");
+#endif
+
+            printf("overlay modules:\n");
+            for (io = alock_modules_overlay; *io; ++io)
+                printf("  %s\n", (*io)->m.name);
+#if ENABLE_PLUGINS
+            listPlugins("overlay");
+#endif
 
             return EXIT_SUCCESS;
         }
 
         case 'a': { /* authentication module */
 
-            struct aModuleAuth **i;
-            for (i = alock_modules_auth; *i; ++i)
-                if (strstr(optarg, (*i)->m.name) == optarg) {
-                    args_auth = optarg;
-                    modules.auth = *i;
-                    break;
-                }
+            char *tokens[8];
+            char *tmp;
+            int count, n;
 
-            if (*i == NULL) {
-                fprintf(stderr, "alock: authentication module `%s` not found\n", optarg);
+            if ((tmp = strdup(optarg)) == NULL) {
+                perror("alock: unable to parse authentication options");
+                return EXIT_FAILURE;
+            }
+
+            if ((count = splitAuthChain(tmp, tokens, sizeof(tokens) / sizeof(*tokens))) == -1) {
+                fprintf(stderr, "alock: too many authentication modules\n");
+                free(tmp);
                 return EXIT_FAILURE;
             }
 
+            /* single module - options are only unescaped */
+            if (count == 1) {
+                if ((modules.auth = findAuthModule(tokens[0])) == NULL) {
+                    fprintf(stderr, "alock: authentication module `%s` not found\n", tokens[0]);
+                    free(tmp);
+                    return EXIT_FAILURE;
+                }
+                strcpy(optarg, tokens[0]);
+                free(tmp);
+                args_auth = optarg;
+                break;
+            }
+
+            /* chain of modules, e.g. "hash:...+pam" */
+            for (n = 0; n < count; n++) {
+                struct aModuleAuth *auth;
+                if ((auth = findAuthModule(tokens[n])) == NULL) {
+                    fprintf(stderr, "alock: authentication module `%s` not found\n", tokens[n]);
+                    free(tmp);
+                    return EXIT_FAILURE;
+                }
+                if (alock_auth_chain_append(auth, tokens[n]) != 0) {
+                    free(tmp);
+                    return EXIT_FAILURE;
+                }
+            }
+
+            free(tmp);
+            args_auth = optarg;
+            modules.auth = &alock_auth_chain;
             break;
         }
 
@@ -506,6 +1031,13 @@ int main(int argc, char **argv) {
                     break;
                 }
 
+#if ENABLE_PLUGINS
+            if (*i == NULL && (modules.background = loadPlugin("bg", optarg)) != NULL) {
+                args_background = optarg;
+                break;
+            }
+#endif
+
             if (*i == NULL) {
                 fprintf(stderr, "alock: background module `%s` not found\n", optarg);
                 return EXIT_FAILURE;
@@ -524,6 +1056,13 @@ int main(int argc, char **argv) {
                     break;
                 }
 
+#if ENABLE_PLUGINS
+            if (*i == NULL && (modules.cursor = loadPlugin("cursor", optarg)) != NULL) {
+                args_cursor = optarg;
+                break;
+            }
+#endif
+
             if (*i == NULL) {
                 fprintf(stderr, "alock: cursor module `%s` not found\n", optarg);
                 return EXIT_FAILURE;
@@ -542,6 +1081,13 @@ int main(int argc, char **argv) {
                     break;
                 }
 
+#if ENABLE_PLUGINS
+            if (*i == NULL && (modules.input = loadPlugin("input", optarg)) != NULL) {
+                args_input = optarg;
+                break;
+            }
+#endif
+
             if (*i == NULL) {
                 fprintf(stderr, "alock: input module `%s` not found\n", optarg);
                 return EXIT_FAILURE;
@@ -550,23 +1096,104 @@ int main(int argc, char **argv) {
             break;
         }
 
+        case 'o': { /* overlay module */
+
+            struct aModuleOverlay **i;
+            for (i = alock_modules_overlay; *i; ++i)
+                if (strstr(optarg, (*i)->m.name) == optarg) {
+                    args_overlay = optarg;
+                    modules.overlay = *i;
+                    break;
+                }
+
+#if ENABLE_PLUGINS
+            if (*i == NULL && (modules.overlay = loadPlugin("overlay", optarg)) != NULL) {
+                args_overlay = optarg;
+                break;
+            }
+#endif
+
+            if (*i == NULL) {
+                fprintf(stderr, "alock: overlay module `%s` not found\n", optarg);
+                return EXIT_FAILURE;
+            }
+
+            break;
+        }
+
+        case 't': /* phase-timing trace */
+            trace_file = optarg;
+            trace_enabled = 1;
+            break;
+
+        case 's': /* speculative verification */
+#if ENABLE_THREADS
+            alock_speculate_delay = optarg ? strtoul(optarg, NULL, 10) : 300;
+#else
+            fprintf(stderr, "alock: speculative verification requires threads support\n");
+#endif
+            break;
+
         default:
             fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
             return EXIT_FAILURE;
         }
 
+    if (trace_enabled && alock_trace_open(trace_file) == -1) {
+        fprintf(stderr, "alock: unable to open trace file `%s`\n", trace_file);
+        return EXIT_FAILURE;
+    }
+
+#if ENABLE_PLUGINS
+    /* load default authentication plug-in */
+    if (args_auth == NULL && alock_plugins_auth_default != NULL) {
+        /* Do not fall back to the "none" module, which would accept any
+         * password - refuse to lock the screen instead. */
+        if ((modules.auth = loadPlugin("auth", alock_plugins_auth_default)) == NULL) {
+            fprintf(stderr, "alock: authentication module `%s` not found\n",
+                    alock_plugins_auth_default);
+            alock_trace_close();
+            return EXIT_FAILURE;
+        }
+    }
+#endif
+
     /* required for correct input handling */
     setlocale(LC_ALL, "");
 
-    if ((display = XOpenDisplay(NULL)) == NULL) {
+#if ENABLE_THREADS
+    /* modules might prepare screens concurrently */
+    if (XInitThreads() == 0)
+        fprintf(stderr, "alock: unable to initialize Xlib threads\n");
+#endif
+
+    /* Background module gets its arguments before the X connection is set
+     * up, so it can start time-consuming preparations (e.g. the decoding of
+     * an image) in the background. Arguments are loaded once again after the
+     * X resources, so they still take precedence. */
+    trace = alock_trace_begin("bg.preload", modules.background->m.name);
+    modules.background->m.loadargs(args_background);
+    alock_trace_end(trace);
+
+    trace = alock_trace_begin("XOpenDisplay", NULL);
+    display = XOpenDisplay(NULL);
+    alock_trace_end(trace);
+
+    if (display == NULL) {
         fprintf(stderr, "error: unable to connect to the X display\n");
+        alock_trace_close();
         return EXIT_FAILURE;
     }
 
     /* make sure, that only one instance of alock is running */
-    if (registerInstance(display)) {
+    trace = alock_trace_begin("registerInstance", NULL);
+    retval = registerInstance(display);
+    alock_trace_end(trace);
+
+    if (retval) {
         fprintf(stderr, "error: another instance seems to be running\n");
         XCloseDisplay(display);
+        alock_trace_close();
         return EXIT_FAILURE;
     }
 
@@ -578,15 +1205,29 @@ int main(int argc, char **argv) {
     { /* try to initialize selected modules */
 
         int rv = 0;
+        int i;
 
+        trace = alock_trace_begin("xrm.load", NULL);
         XrmInitialize();
         const char *data = XResourceManagerString(display);
         XrmDatabase xrdb = XrmGetStringDatabase(data != NULL ? data : "");
+        alock_trace_end(trace);
 
+        trace = alock_trace_begin("auth.loadxrdb", modules.auth->m.name);
         modules.auth->m.loadxrdb(xrdb);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("bg.loadxrdb", modules.background->m.name);
         modules.background->m.loadxrdb(xrdb);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("cursor.loadxrdb", modules.cursor->m.name);
         modules.cursor->m.loadxrdb(xrdb);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("input.loadxrdb", modules.input->m.name);
         modules.input->m.loadxrdb(xrdb);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("overlay.loadxrdb", modules.overlay->m.name);
+        modules.overlay->m.loadxrdb(xrdb);
+        alock_trace_end(trace);
 
 #if WITH_XBLIGHT
         XrmValue value;
@@ -599,12 +1240,27 @@ int main(int argc, char **argv) {
 
         XrmDestroyDatabase(xrdb);
 
+        trace = alock_trace_begin("auth.loadargs", modules.auth->m.name);
         modules.auth->m.loadargs(args_auth);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("bg.loadargs", modules.background->m.name);
         modules.background->m.loadargs(args_background);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("cursor.loadargs", modules.cursor->m.name);
         modules.cursor->m.loadargs(args_cursor);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("input.loadargs", modules.input->m.name);
         modules.input->m.loadargs(args_input);
+        alock_trace_end(trace);
+        trace = alock_trace_begin("overlay.loadargs", modules.overlay->m.name);
+        modules.overlay->m.loadargs(args_overlay);
+        alock_trace_end(trace);
 
-        if (modules.auth->m.init(display)) {
+        trace = alock_trace_begin("auth.init", modules.auth->m.name);
+        retval = modules.auth->m.init(display);
+        alock_trace_end(trace);
+
+        if (retval) {
             fprintf(stderr, "alock: failed init of [%s] with [%s]\n",
                     modules.auth->m.name, args_auth);
             rv |= 1;
@@ -617,30 +1273,62 @@ int main(int argc, char **argv) {
             perror("alock: root privilege drop failed");
 #endif
 
-        if (modules.background->m.init(display)) {
+        trace = alock_trace_begin("bg.init", modules.background->m.name);
+        retval = modules.background->m.init(display);
+        alock_trace_end(trace);
+
+        if (retval) {
             fprintf(stderr, "alock: failed init of [%s] with [%s]\n",
                     modules.background->m.name, args_background);
             rv |= 1;
         }
-        if (modules.cursor->m.init(display)) {
+        trace = alock_trace_begin("cursor.init", modules.cursor->m.name);
+        retval = modules.cursor->m.init(display);
+        alock_trace_end(trace);
+
+        if (retval) {
             fprintf(stderr, "alock: failed init of [%s] with [%s]\n",
                     modules.cursor->m.name, args_cursor);
             rv |= 1;
         }
-        if (modules.input->m.init(display)) {
+        trace = alock_trace_begin("input.init", modules.input->m.name);
+        retval = modules.input->m.init(display);
+        alock_trace_end(trace);
+
+        if (retval) {
             fprintf(stderr, "alock: failed init of [%s] with [%s]\n",
                     modules.input->m.name, args_input);
             rv |= 1;
         }
+        trace = alock_trace_begin("overlay.init", modules.overlay->m.name);
+        retval = modules.overlay->m.init(display);
+        alock_trace_end(trace);
+
+        if (retval) {
+            fprintf(stderr, "alock: failed init of [%s] with [%s]\n",
+                    modules.overlay->m.name, args_overlay);
+            rv |= 1;
+        }
 
         if (rv) /* initialization failed */
             goto return_failure;
 
+        /* overlay is drawn on top of the background */
+        for (i = 0; i < ScreenCount(display); i++) {
+            Window window;
+            if ((window = modules.background->getwindow(i)) != None)
+                modules.overlay->attach(i, window);
+        }
+
     }
 
     /* raise our background window and grab input, if this action has failed,
      * we are not able to lock the screen, then we're fucked... */
-    if (lockDisplay(display, &modules))
+    trace = alock_trace_begin("lockDisplay", NULL);
+    retval = lockDisplay(display, &modules);
+    alock_trace_end(trace);
+
+    if (retval)
         goto return_failure;
 
     debug("entering main event loop");
@@ -654,10 +1342,18 @@ return_failure:
 
 return_success:
 
-    modules.auth->m.free();
+    trace = alock_trace_begin("cursor.free", modules.cursor->m.name);
     modules.cursor->m.free();
+    alock_trace_end(trace);
+    trace = alock_trace_begin("input.free", modules.input->m.name);
     modules.input->m.free();
+    alock_trace_end(trace);
+    trace = alock_trace_begin("overlay.free", modules.overlay->m.name);
+    modules.overlay->m.free();
+    alock_trace_end(trace);
+    trace = alock_trace_begin("bg.free", modules.background->m.name);
     modules.background->m.free();
+    alock_trace_end(trace);
 
     unregisterInstance(display);
     XCloseDisplay(display);
@@ -667,5 +1363,20 @@ return_success:
     system("pkill -x -SIGUSR2 dunst");
 #endif
 
+    /* Authentication module is released after the display has been unlocked,
+     * because it might perform some post-authentication work (e.g. refresh
+     * the PAM verifier cache), which should not delay the user. The discarded
+     * speculative verification might still use the module. */
+    speculationPoll(&speculation, 1);
+    trace = alock_trace_begin("auth.free", modules.auth->m.name);
+    modules.auth->m.free();
+    alock_trace_end(trace);
+
+    alock_trace_close();
+
+#if ENABLE_PLUGINS
+    unloadPlugins();
+#endif
+
     return retval;
 }
@@ -0,0 +1,42 @@
+/*
+ * alock - overlay_none.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This overlay module provides:
+ *  -overlay none
+ *
+ */
+
+#include "alock.h"
+
+
+static void module_attach(int screen, Window window) {
+    (void)screen;
+    (void)window;
+}
+
+static long module_refresh(void) {
+    return -1;
+}
+
+static void module_expose(Window window, Region region) {
+    (void)window;
+    (void)region;
+}
+
+
+struct aModuleOverlay alock_overlay_none = {
+    { "none",
+        module_dummy_loadargs,
+        module_dummy_loadxrdb,
+        module_dummy_init,
+        module_dummy_free,
+    },
+    module_attach,
+    module_refresh,
+    module_expose,
+};
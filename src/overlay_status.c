@@ -0,0 +1,425 @@
+/*
+ * alock - overlay_status.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * This overlay module provides:
+ *  -overlay status:font=<xfontname>,color=<color>,format=<strftime>
+ *
+ * Used resources:
+ *  ALock.Overlay.Status.Font
+ *  ALock.Overlay.Status.Color
+ *  ALock.Overlay.Status.Format
+ *
+ * Status line (current time, battery capacity and keyboard layout) drawn in
+ * the top-left corner of the background window. Glyphs of the given core font
+ * are uploaded into the XRender glyph set once during the initialization, and
+ * every glyph occupies a cell of the same width. Upon refresh only changed
+ * cells are redrawn. Refreshes are aligned with the minute boundary (or with
+ * the second one, if the format contains seconds).
+ *
+ */
+
+#include "alock.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/Xrender.h>
+
+
+/* range of cached glyphs (printable ASCII) */
+#define STATUS_GLYPH_FIRST 32
+#define STATUS_GLYPH_LAST 126
+
+struct screenData {
+    Window window;
+    Picture picture;
+};
+
+static struct moduleData {
+    Display *display;
+    struct screenData *screens;
+    char *fontname;
+    char *colorname;
+    char *format;
+    /* battery capacity file, if available */
+    char *battery;
+    GlyphSet glyphset;
+    Picture fill;
+    int cell_width;
+    int ascent;
+    int descent;
+    /* currently displayed text */
+    char text[128];
+} data = { NULL, NULL, NULL, NULL, NULL, NULL, None, None, 0, 0, 0, { 0 } };
+
+
+static void module_loadargs(const char *args) {
+
+    if (!args || strstr(args, "status:") != args)
+        return;
+
+    char *arguments = strdup(&args[7]);
+    char *arg;
+    char *tmp;
+
+    for (tmp = arguments; tmp; ) {
+        arg = strsep(&tmp, ",");
+        if (strstr(arg, "font=") == arg) {
+            free(data.fontname);
+            data.fontname = strdup(&arg[5]);
+        }
+        else if (strstr(arg, "color=") == arg) {
+            free(data.colorname);
+            data.colorname = strdup(&arg[6]);
+        }
+        else if (strstr(arg, "format=") == arg) {
+            free(data.format);
+            data.format = strdup(&arg[7]);
+        }
+    }
+
+    free(arguments);
+}
+
+static void module_loadxrdb(XrmDatabase xrdb) {
+
+    XrmValue value;
+    char *type;
+
+    if (XrmGetResource(xrdb, "alock.overlay.status.font",
+                "ALock.Overlay.Status.Font", &type, &value))
+        data.fontname = strdup(value.addr);
+    if (XrmGetResource(xrdb, "alock.overlay.status.color",
+                "ALock.Overlay.Status.Color", &type, &value))
+        data.colorname = strdup(value.addr);
+    if (XrmGetResource(xrdb, "alock.overlay.status.format",
+                "ALock.Overlay.Status.Format", &type, &value))
+        data.format = strdup(value.addr);
+
+}
+
+/* Find the capacity file of the first battery in the system. */
+static char *find_battery(void) {
+
+    const char *dirname = "/sys/class/power_supply";
+    struct dirent *ent;
+    char *path = NULL;
+    DIR *dir;
+
+    if ((dir = opendir(dirname)) == NULL)
+        return NULL;
+
+    while ((ent = readdir(dir)) != NULL)
+        if (strncmp(ent->d_name, "BAT", 3) == 0) {
+            size_t size = strlen(dirname) + strlen(ent->d_name) + 11;
+            path = malloc(size);
+            snprintf(path, size, "%s/%s/capacity", dirname, ent->d_name);
+            break;
+        }
+
+    closedir(dir);
+    return path;
+}
+
+/* Render all cached glyphs with the core font and upload them into the
+ * glyph set. All glyphs are drawn into one bitmap, so the whole operation
+ * requires only one round trip to the server. */
+static GlyphSet create_glyphset(Display *dpy, XFontStruct *font) {
+
+    const int count = STATUS_GLYPH_LAST - STATUS_GLYPH_FIRST + 1;
+    const int width = data.cell_width;
+    const int height = data.ascent + data.descent;
+    const int stride = (width + 3) & ~3;
+    Window root = DefaultRootWindow(dpy);
+    Glyph gids[STATUS_GLYPH_LAST - STATUS_GLYPH_FIRST + 1];
+    XGlyphInfo glyphs[STATUS_GLYPH_LAST - STATUS_GLYPH_FIRST + 1];
+    GlyphSet glyphset;
+    XGCValues gcval;
+    XImage *image;
+    Pixmap pixmap;
+    char *buffer;
+    GC gc;
+    int i, x, y;
+
+    pixmap = XCreatePixmap(dpy, root, width * count, height, 1);
+
+    gcval.foreground = 0;
+    gcval.font = font->fid;
+    gc = XCreateGC(dpy, pixmap, GCForeground | GCFont, &gcval);
+    XFillRectangle(dpy, pixmap, gc, 0, 0, width * count, height);
+
+    XSetForeground(dpy, gc, 1);
+    for (i = 0; i < count; i++) {
+        char c = STATUS_GLYPH_FIRST + i;
+        XDrawString(dpy, pixmap, gc, i * width, data.ascent, &c, 1);
+    }
+
+    image = XGetImage(dpy, pixmap, 0, 0, width * count, height, 1, ZPixmap);
+    XFreeGC(dpy, gc);
+    XFreePixmap(dpy, pixmap);
+
+    if (image == NULL)
+        return None;
+
+    /* glyph images are stored as A8 bitmaps with rows padded to 4 bytes */
+    if ((buffer = calloc(count, stride * height)) == NULL) {
+        XDestroyImage(image);
+        return None;
+    }
+
+    for (i = 0; i < count; i++) {
+        for (y = 0; y < height; y++)
+            for (x = 0; x < width; x++)
+                if (XGetPixel(image, i * width + x, y))
+                    buffer[(i * height + y) * stride + x] = (char)0xff;
+        gids[i] = STATUS_GLYPH_FIRST + i;
+        glyphs[i].width = width;
+        glyphs[i].height = height;
+        glyphs[i].x = 0;
+        glyphs[i].y = data.ascent;
+        glyphs[i].xOff = width;
+        glyphs[i].yOff = 0;
+    }
+
+    XDestroyImage(image);
+
+    glyphset = XRenderCreateGlyphSet(dpy, XRenderFindStandardFormat(dpy, PictStandardA8));
+    XRenderAddGlyphs(dpy, glyphset, gids, glyphs, count, buffer, count * stride * height);
+
+    free(buffer);
+    return glyphset;
+}
+
+static int module_init(Display *dpy) {
+
+    XRenderColor color;
+    XFontStruct *font;
+    XColor xcolor;
+
+    if (!alock_check_xrender(dpy))
+        return -1;
+
+    if ((font = XLoadQueryFont(dpy, data.fontname ? data.fontname : "fixed")) == NULL) {
+        fprintf(stderr, "[status]: unable to load font: %s\n", data.fontname);
+        if ((font = XLoadQueryFont(dpy, "fixed")) == NULL)
+            return -1;
+    }
+
+    data.display = dpy;
+    data.cell_width = font->max_bounds.width;
+    data.ascent = font->ascent;
+    data.descent = font->descent;
+    data.glyphset = create_glyphset(dpy, font);
+    XFreeFont(dpy, font);
+
+    if (data.glyphset == None) {
+        fprintf(stderr, "[status]: unable to create glyph set\n");
+        return -1;
+    }
+
+    alock_alloc_color(dpy, DefaultColormap(dpy, DefaultScreen(dpy)),
+            data.colorname, "white", &xcolor);
+    color.red = xcolor.red;
+    color.green = xcolor.green;
+    color.blue = xcolor.blue;
+    color.alpha = 0xffff;
+    data.fill = XRenderCreateSolidFill(dpy, &color);
+
+    data.screens = (struct screenData *)calloc(ScreenCount(dpy), sizeof(*data.screens));
+    data.battery = find_battery();
+
+    return 0;
+}
+
+static void module_free(void) {
+
+    int i;
+
+    if (data.screens) {
+        for (i = 0; i < ScreenCount(data.display); i++)
+            if (data.screens[i].picture != None)
+                XRenderFreePicture(data.display, data.screens[i].picture);
+        free(data.screens);
+        data.screens = NULL;
+    }
+
+    if (data.fill != None)
+        XRenderFreePicture(data.display, data.fill);
+    data.fill = None;
+    if (data.glyphset != None)
+        XRenderFreeGlyphSet(data.display, data.glyphset);
+    data.glyphset = None;
+
+    free(data.fontname);
+    data.fontname = NULL;
+    free(data.colorname);
+    data.colorname = NULL;
+    free(data.format);
+    data.format = NULL;
+    free(data.battery);
+    data.battery = NULL;
+
+}
+
+/* Get the name of the currently active keyboard layout. */
+static int get_layout(char *buffer, size_t size) {
+
+    XkbStateRec state;
+    XkbDescPtr desc;
+    char *name;
+    int rv = -1;
+
+    if (XkbGetState(data.display, XkbUseCoreKbd, &state) != Success)
+        return -1;
+    if ((desc = XkbAllocKeyboard()) == NULL)
+        return -1;
+
+    if (XkbGetNames(data.display, XkbGroupNamesMask, desc) == Success &&
+            desc->names->groups[state.group] != None &&
+            (name = XGetAtomName(data.display, desc->names->groups[state.group])) != NULL) {
+        snprintf(buffer, size, "%s", name);
+        XFree(name);
+        rv = 0;
+    }
+
+    XkbFreeKeyboard(desc, 0, True);
+    return rv;
+}
+
+/* Compose the status line from all available sources. */
+static void get_text(char *buffer, size_t size) {
+
+    time_t now = time(NULL);
+    char tmp[64];
+    size_t len;
+    FILE *f;
+
+    /* NOTE: Buffer content is undefined when the result does not fit. */
+    if ((len = strftime(buffer, size, data.format ? data.format : "%H:%M", localtime(&now))) == 0)
+        buffer[0] = '\0';
+
+    if (data.battery && (f = fopen(data.battery, "r")) != NULL) {
+        if (fgets(tmp, sizeof(tmp), f) != NULL)
+            len += snprintf(&buffer[len], size - len, "  %d%%", atoi(tmp));
+        fclose(f);
+    }
+
+    if (len < size && get_layout(tmp, sizeof(tmp)) == 0)
+        snprintf(&buffer[len], size - len, "  %s", tmp);
+
+}
+
+/* Draw given range of text cells on every attached screen. If the clear flag
+ * is set, cells are restored to the window background beforehand. */
+static void draw_cells(int first, int count, int clear) {
+
+    int x = data.cell_width + first * data.cell_width;
+    int y = data.cell_width;
+    int len = strlen(data.text);
+    int i;
+
+    for (i = 0; i < ScreenCount(data.display); i++) {
+        struct screenData *sd = &data.screens[i];
+        if (sd->picture == None)
+            continue;
+        if (clear)
+            XClearArea(data.display, sd->window, x, y,
+                    count * data.cell_width, data.ascent + data.descent, False);
+        if (first < len)
+            XRenderCompositeString8(data.display, PictOpOver, data.fill, sd->picture,
+                    NULL, data.glyphset, 0, 0, x, y + data.ascent, &data.text[first],
+                    first + count > len ? len - first : count);
+    }
+
+}
+
+static void module_attach(int screen, Window window) {
+
+    Display *dpy = data.display;
+    XWindowAttributes xwa;
+
+    XGetWindowAttributes(dpy, window, &xwa);
+    /* background window content is restored by the server, but the status
+     * line has to be redrawn by us */
+    XSelectInput(dpy, window, xwa.your_event_mask | ExposureMask);
+
+    data.screens[screen].window = window;
+    data.screens[screen].picture = XRenderCreatePicture(dpy, window,
+            XRenderFindVisualFormat(dpy, xwa.visual), 0, NULL);
+
+}
+
+static long module_refresh(void) {
+
+    char old[sizeof(data.text)];
+    struct timespec ts;
+    long interval = 60000;
+    int len, old_len, max;
+    int i, first;
+
+    memcpy(old, data.text, sizeof(old));
+    get_text(data.text, sizeof(data.text));
+    len = strlen(data.text);
+    old_len = strlen(old);
+    max = len > old_len ? len : old_len;
+
+    /* redraw changed runs of cells only */
+    for (i = 0, first = -1; i <= max; i++) {
+        int changed = i < max && (i >= len || i >= old_len || data.text[i] != old[i]);
+        if (changed && first == -1)
+            first = i;
+        else if (!changed && first != -1) {
+            draw_cells(first, i - first, 1);
+            first = -1;
+        }
+    }
+
+    XFlush(data.display);
+
+    /* align the next refresh with the boundary of the displayed unit */
+    if (data.format && (strstr(data.format, "%S") || strstr(data.format, "%T") ||
+                strstr(data.format, "%r") || strstr(data.format, "%s")))
+        interval = 1000;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return interval - (ts.tv_sec % (interval / 1000) * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void module_expose(Window window, Region region) {
+
+    int i;
+
+    for (i = 0; i < ScreenCount(data.display); i++) {
+        struct screenData *sd = &data.screens[i];
+        if (sd->window != window || sd->picture == None)
+            continue;
+        if (XRectInRegion(region, data.cell_width, data.cell_width,
+                    strlen(data.text) * data.cell_width,
+                    data.ascent + data.descent) != RectangleOut)
+            XRenderCompositeString8(data.display, PictOpOver, data.fill, sd->picture,
+                    NULL, data.glyphset, 0, 0, data.cell_width,
+                    data.cell_width + data.ascent, data.text, strlen(data.text));
+    }
+
+}
+
+
+struct aModuleOverlay alock_overlay_status = {
+    { "status",
+        module_loadargs,
+        module_loadxrdb,
+        module_init,
+        module_free,
+    },
+    module_attach,
+    module_refresh,
+    module_expose,
+};
@@ -0,0 +1,43 @@
+/*
+ * alock - pam_alock_bench.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * Stub PAM module used by the authentication modules micro-benchmark. It
+ * accepts the password given with the "password=<pass>" module argument (by
+ * default "alock-bench") for any user, so the PAM module can be benchmarked
+ * without the access to the system password database.
+ *
+ */
+
+#include <string.h>
+#include <security/pam_modules.h>
+
+
+int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc, const char **argv) {
+    (void)flags;
+
+    const char *password = "alock-bench";
+    const char *authtok;
+    int i;
+
+    for (i = 0; i < argc; i++)
+        if (strstr(argv[i], "password=") == argv[i])
+            password = &argv[i][9];
+
+    if (pam_get_authtok(pamh, PAM_AUTHTOK, &authtok, NULL) != PAM_SUCCESS)
+        return PAM_AUTH_ERR;
+
+    return strcmp(authtok, password) == 0 ? PAM_SUCCESS : PAM_AUTH_ERR;
+}
+
+int pam_sm_setcred(pam_handle_t *pamh, int flags, int argc, const char **argv) {
+    (void)pamh;
+    (void)flags;
+    (void)argc;
+    (void)argv;
+    return PAM_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/*
+ * alock - test-grayscale.c
+ * Copyright (c) 2026 Arkadiusz Bokowy
+ *
+ * This file is a part of an alock.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ * Test of the client-side grayscale conversion. Images with common TrueColor
+ * layouts are filled with pseudo-random pixels and converted, then every
+ * channel is compared with the luminance computed in floating point. Bits
+ * outside of the color masks (e.g. alpha) have to be preserved. Images are
+ * created by the XInitImage(), so the X server is not required.
+ *
+ * The fused grayscale and shade conversion is tested in the same way, with
+ * the luminance blended with the tint color. Only the sub-area of the image
+ * is converted, so the rest has to be left intact. Layouts which are not
+ * supported by the fused conversion have to be rejected without changes.
+ *
+ */
+
+#include "alock.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <X11/Xutil.h>
+
+#define TEST_WIDTH 37
+#define TEST_HEIGHT 5
+
+struct testLayout {
+    const char *name;
+    int depth;
+    int bpp;
+    unsigned long masks[3];
+};
+
+static const struct testLayout layouts[] = {
+    { "RGB565", 16, 16, { 0xf800, 0x07e0, 0x001f } },
+    { "RGB555", 15, 16, { 0x7c00, 0x03e0, 0x001f } },
+    { "RGB888 packed", 24, 24, { 0xff0000, 0x00ff00, 0x0000ff } },
+    { "xRGB8888", 24, 32, { 0xff0000, 0x00ff00, 0x0000ff } },
+    { "xBGR8888", 24, 32, { 0x0000ff, 0x00ff00, 0xff0000 } },
+    { "ARGB8888", 32, 32, { 0xff0000, 0x00ff00, 0x0000ff } },
+    { "xRGB2101010", 30, 32, { 0x3ff00000, 0x000ffc00, 0x000003ff } },
+    { "xBGR2101010", 30, 32, { 0x000003ff, 0x000ffc00, 0x3ff00000 } },
+};
+
+/* Get the normalized value of the channel with the given mask. */
+static double channel(unsigned long pixel, unsigned long mask) {
+    while (!(mask & 1)) {
+        mask >>= 1;
+        pixel >>= 1;
+    }
+    return (double)(pixel & mask) / mask;
+}
+
+/* Get the smallest step of the channel with the given mask. */
+static double channel_step(unsigned long mask) {
+    while (!(mask & 1))
+        mask >>= 1;
+    return 1.0 / mask;
+}
+
+static XImage *test_image(const struct testLayout *l, int order) {
+
+    XImage *image;
+
+    if ((image = calloc(1, sizeof(*image))) == NULL)
+        return NULL;
+
+    image->width = TEST_WIDTH;
+    image->height = TEST_HEIGHT;
+    image->format = ZPixmap;
+    image->byte_order = order;
+    image->bitmap_unit = 32;
+    image->bitmap_bit_order = order;
+    image->bitmap_pad = 32;
+    image->depth = l->depth;
+    image->bits_per_pixel = l->bpp;
+    image->red_mask = l->masks[0];
+    image->green_mask = l->masks[1];
+    image->blue_mask = l->masks[2];
+
+    if (!XInitImage(image) ||
+            (image->data = calloc(image->bytes_per_line, image->height)) == NULL) {
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+static void test_image_free(XImage *image) {
+    free(image->data);
+    free(image);
+}
+
+/* Convert the whole image and compare it with the reference. This function
+ * returns the number of wrong pixels. */
+static int test_grayscale(const struct testLayout *l, int order) {
+
+    /* the XGetPixel() masks out bits above the image depth */
+    const unsigned long all = l->depth == 32 ? 0xffffffffUL : (1UL << l->depth) - 1;
+    const unsigned long colors = l->masks[0] | l->masks[1] | l->masks[2];
+    unsigned long ref[TEST_WIDTH * TEST_HEIGHT];
+    double tolerance = 0;
+    double error, e, luma;
+    XImage *image;
+    int x, y, i;
+    int failed = 0;
+
+    if ((image = test_image(l, order)) == NULL) {
+        fprintf(stderr, "%s: unable to create image\n", l->name);
+        return 1;
+    }
+
+    /* the quantization of the output plus the integer luminance weights */
+    for (i = 0; i < 3; i++)
+        if (channel_step(l->masks[i]) > tolerance)
+            tolerance = channel_step(l->masks[i]);
+    tolerance += 0.01;
+
+    srand(l->depth * l->bpp + order);
+    for (y = 0; y < TEST_HEIGHT; y++)
+        for (x = 0; x < TEST_WIDTH; x++) {
+            ref[y * TEST_WIDTH + x] = ((unsigned long)rand() << 16 ^ rand()) & all;
+            XPutPixel(image, x, y, ref[y * TEST_WIDTH + x]);
+        }
+
+    if (!alock_grayscale_image(image, 0, 0, TEST_WIDTH, TEST_HEIGHT)) {
+        fprintf(stderr, "%s: conversion not supported\n", l->name);
+        test_image_free(image);
+        return 1;
+    }
+
+    error = 0;
+    for (y = 0; y < TEST_HEIGHT; y++)
+        for (x = 0; x < TEST_WIDTH; x++) {
+
+            unsigned long v = XGetPixel(image, x, y);
+            unsigned long o = ref[y * TEST_WIDTH + x];
+            int bad = 0;
+
+            luma = 0.2126 * channel(o, l->masks[0]) +
+                0.7152 * channel(o, l->masks[1]) +
+                0.0722 * channel(o, l->masks[2]);
+
+            for (i = 0; i < 3; i++) {
+                e = fabs(channel(v, l->masks[i]) - luma);
+                if (e > error)
+                    error = e;
+                if (e > tolerance)
+                    bad = 1;
+            }
+
+            if ((v & ~colors) != (o & ~colors))
+                bad = 1;
+
+            failed += bad;
+        }
+
+    printf("%-14s %s: max error %.4f (tolerance %.4f): %s\n", l->name,
+            order == LSBFirst ? "LSB" : "MSB", error, tolerance,
+            failed ? "FAIL" : "OK");
+
+    test_image_free(image);
+    return failed;
+}
+
+/* Check whether the fused conversion supports given layout - 32-bit pixels
+ * with 8-bit channels. */
+static int shade_supported(const struct testLayout *l) {
+    unsigned int i;
+    for (i = 0; i < 3; i++)
+        if (channel_step(l->masks[i]) != 1.0 / 0xff)
+            return 0;
+    return l->bpp == 32;
+}
+
+/* Convert and shade the sub-area of the image and compare it with the
+ * reference. This function returns the number of wrong pixels. */
+static int test_grayscale_shade(const struct testLayout *l, int order, unsigned char shade) {
+
+    const XColor tint = { .red = 0x1234, .green = 0x8000, .blue = 0xffff };
+    const double tints[3] = { 0x12 / 255.0, 0x80 / 255.0, 0xff / 255.0 };
+    const double alpha = (255 * shade / 100) / 255.0;
+    const int ax = 3, ay = 1, aw = TEST_WIDTH - 5, ah = TEST_HEIGHT - 2;
+    const unsigned long all = l->depth == 32 ? 0xffffffffUL : (1UL << l->depth) - 1;
+    const unsigned long colors = l->masks[0] | l->masks[1] | l->masks[2];
+    const int supported = shade_supported(l);
+    unsigned long ref[TEST_WIDTH * TEST_HEIGHT];
+    double tolerance = 0;
+    double error, e, luma;
+    XImage *image;
+    int x, y, i;
+    int failed = 0;
+
+    if ((image = test_image(l, order)) == NULL) {
+        fprintf(stderr, "%s: unable to create image\n", l->name);
+        return 1;
+    }
+
+    for (i = 0; i < 3; i++)
+        if (channel_step(l->masks[i]) > tolerance)
+            tolerance = channel_step(l->masks[i]);
+    tolerance += 0.01;
+
+    srand(l->depth * l->bpp + order + shade);
+    for (y = 0; y < TEST_HEIGHT; y++)
+        for (x = 0; x < TEST_WIDTH; x++) {
+            ref[y * TEST_WIDTH + x] = ((unsigned long)rand() << 16 ^ rand()) & all;
+            XPutPixel(image, x, y, ref[y * TEST_WIDTH + x]);
+        }
+
+    if (alock_grayscale_shade_image(image, ax, ay, aw, ah, &tint, shade) != supported) {
+        fprintf(stderr, "%s: fused conversion %s\n", l->name,
+                supported ? "not supported" : "not rejected");
+        test_image_free(image);
+        return 1;
+    }
+
+    error = 0;
+    for (y = 0; y < TEST_HEIGHT; y++)
+        for (x = 0; x < TEST_WIDTH; x++) {
+
+            unsigned long v = XGetPixel(image, x, y);
+            unsigned long o = ref[y * TEST_WIDTH + x];
+            int bad = 0;
+
+            /* pixels outside of the area (or of the rejected image) */
+            if (!supported || x < ax || x >= ax + aw || y < ay || y >= ay + ah) {
+                failed += v != o;
+                continue;
+            }
+
+            luma = 0.2126 * channel(o, l->masks[0]) +
+                0.7152 * channel(o, l->masks[1]) +
+                0.0722 * channel(o, l->masks[2]);
+
+            for (i = 0; i < 3; i++) {
+                e = fabs(channel(v, l->masks[i]) - (luma * alpha + tints[i] * (1 - alpha)));
+                if (e > error)
+                    error = e;
+                if (e > tolerance)
+                    bad = 1;
+            }
+
+            if ((v & ~colors) != (o & ~colors))
+                bad = 1;
+
+            failed += bad;
+        }
+
+    if (supported)
+        printf("%-14s %s: shade %3d: max error %.4f (tolerance %.4f): %s\n", l->name,
+                order == LSBFirst ? "LSB" : "MSB", shade, error, tolerance,
+                failed ? "FAIL" : "OK");
+    else
+        printf("%-14s %s: shade %3d: rejected: %s\n", l->name,
+                order == LSBFirst ? "LSB" : "MSB", shade, failed ? "FAIL" : "OK");
+
+    test_image_free(image);
+    return failed;
+}
+
+int main(void) {
+
+    const int orders[] = { LSBFirst, MSBFirst };
+    const unsigned char shades[] = { 0, 37, 100 };
+    unsigned int i, o, s;
+    int failed = 0;
+
+    for (i = 0; i < sizeof(layouts) / sizeof(*layouts); i++)
+        for (o = 0; o < sizeof(orders) / sizeof(*orders); o++)
+            if (test_grayscale(&layouts[i], orders[o]))
+                failed++;
+
+    for (i = 0; i < sizeof(layouts) / sizeof(*layouts); i++)
+        for (o = 0; o < sizeof(orders) / sizeof(*orders); o++)
+            for (s = 0; s < sizeof(shades) / sizeof(*shades); s++)
+                if (test_grayscale_shade(&layouts[i], orders[o], shades[s]))
+                    failed++;
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -12,19 +12,44 @@
 #include "alock.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
 #include <X11/Xutil.h>
-#if ENABLE_IMLIB2
+#if ENABLE_THREADS
+# include <pthread.h>
+#endif
+#if HAVE_XEXT && !ALOCK_PLUGIN
+# include <sys/ipc.h>
+# include <sys/shm.h>
+# include <X11/extensions/XShm.h>
+#endif
+#if HAVE_X11_XCB && !ALOCK_PLUGIN
+# include <X11/Xlib-xcb.h>
+# include <xcb/xcb.h>
+#endif
+#if ENABLE_IMLIB2 && !ALOCK_PLUGIN_HOST
 # include <Imlib2.h>
 #endif
-#if ENABLE_XRENDER
+#if ENABLE_XRENDER && !ALOCK_PLUGIN_HOST
 # include <X11/extensions/Xrender.h>
 #endif
 
+/* NOTE: When modules are built as plug-ins, helpers from this file are split
+ *       into two groups. Generic ones are compiled into the main executable
+ *       (ALOCK_PLUGIN_HOST) and exported for plug-ins, while graphic helpers,
+ *       which depend on optional libraries, are compiled into plug-ins which
+ *       need them (ALOCK_PLUGIN). This way the main executable is linked with
+ *       the core X11 libraries only. */
+
+
+#if !ALOCK_PLUGIN
 
 /* Get system time-stamp in milliseconds without discontinuities. */
 unsigned long alock_mtime() {
@@ -38,6 +63,273 @@ unsigned long alock_mtime() {
     return t.tv_sec * 1000 + t.tv_nsec / 1000000;
 }
 
+#if ENABLE_THREADS
+struct parallel_data {
+    int (*func)(unsigned int index, void *arg);
+    void *arg;
+    unsigned int count;
+    unsigned int next;
+    int status;
+};
+
+/* Worker routine - process indexes until the queue is exhausted. */
+static void *parallel_worker(void *arg) {
+
+    struct parallel_data *pd = (struct parallel_data *)arg;
+    unsigned int i;
+
+    while ((i = __atomic_fetch_add(&pd->next, 1, __ATOMIC_RELAXED)) < pd->count)
+        if (pd->func(i, pd->arg) != 0)
+            __atomic_store_n(&pd->status, -1, __ATOMIC_RELAXED);
+
+    return NULL;
+}
+#endif /* ENABLE_THREADS */
+
+/* Call given function for every index in the range [0, count). When threads
+ * are enabled, calls are distributed among the pool of workers (one worker
+ * per online CPU, the calling thread included), so the given function has
+ * to be thread-safe. Note, that Xlib calls are safe only if XInitThreads()
+ * was called beforehand. This function returns 0 if all calls succeeded,
+ * otherwise -1. */
+int alock_parallel(unsigned int count,
+        int (*func)(unsigned int index, void *arg),
+        void *arg) {
+#if ENABLE_THREADS
+
+    struct parallel_data pd = { func, arg, count, 0, 0 };
+    pthread_t *threads;
+    long ncpu;
+    unsigned int i, n;
+
+    if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        ncpu = 1;
+    n = count < ncpu ? count : ncpu;
+
+    threads = n > 1 ? (pthread_t *)malloc(sizeof(*threads) * (n - 1)) : NULL;
+    for (i = 0; threads && i < n - 1; i++)
+        if (pthread_create(&threads[i], NULL, parallel_worker, &pd) != 0)
+            break;
+
+    debug("parallel: %u tasks, %u workers", count, i + 1);
+    parallel_worker(&pd);
+
+    while (i--)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    return pd.status;
+#else
+    int status = 0;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+        if (func(i, arg) != 0)
+            status = -1;
+
+    return status;
+#endif /* ENABLE_THREADS */
+}
+
+/* Open the file with the rights of the real user. When alock is installed
+ * setuid root, file names given by the user must not be opened with the
+ * elevated privileges, otherwise any file in the system could be created or
+ * overwritten (or read). Callers which create files should pass O_NOFOLLOW,
+ * so symbolic links are not followed. This function returns the file
+ * descriptor or -1 on error. */
+int alock_open_user(const char *filename, int flags, mode_t mode) {
+
+    uid_t euid = geteuid();
+    gid_t egid = getegid();
+    int fd, err;
+
+    if (euid == getuid() && egid == getgid())
+        return open(filename, flags | O_CLOEXEC, mode);
+
+    if (setegid(getgid()) != 0)
+        return -1;
+    if (seteuid(getuid()) != 0) {
+        err = errno;
+        fd = -1;
+        goto restore;
+    }
+
+    fd = open(filename, flags | O_CLOEXEC, mode);
+    err = errno;
+
+    if (seteuid(euid) != 0) {
+        fprintf(stderr, "alock: unable to restore privileges\n");
+        exit(EXIT_FAILURE);
+    }
+
+restore:
+    if (setegid(egid) != 0) {
+        fprintf(stderr, "alock: unable to restore privileges\n");
+        exit(EXIT_FAILURE);
+    }
+
+    errno = err;
+    return fd;
+}
+
+#define TRACE_EVENTS_MAX 512
+static struct traceData {
+    FILE *file;
+    unsigned long origin;
+    unsigned int count;
+    struct {
+        const char *name;
+        const char *category;
+        unsigned long ts;
+        long dur;
+        int tid;
+        /* optional numerical argument */
+        const char *arg;
+        long value;
+    } events[TRACE_EVENTS_MAX];
+} trace = { 0 };
+
+/* Get system time-stamp in microseconds without discontinuities. */
+static unsigned long trace_utime(void) {
+    struct timespec t;
+#ifdef CLOCK_BOOTTIME
+    clock_gettime(CLOCK_BOOTTIME, &t);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &t);
+#endif
+    return t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/* Get the sequential number of the calling thread. */
+static int trace_tid(void) {
+    static int counter = 0;
+    static __thread int tid = 0;
+    if (tid == 0)
+        tid = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+    return tid;
+}
+
+/* Enable phase-timing trace. Collected events are written to the given file
+ * (or to the stderr if filename is NULL) by the alock_trace_close(). This
+ * function returns 0 on success, otherwise -1. */
+int alock_trace_open(const char *filename) {
+
+    int fd;
+
+    if (filename == NULL)
+        trace.file = stderr;
+    else {
+        /* the file name is given by the user, so open it with user rights */
+        if ((fd = alock_open_user(filename,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644)) == -1)
+            return -1;
+        if ((trace.file = fdopen(fd, "w")) == NULL) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    trace.origin = trace_utime();
+    return 0;
+}
+
+/* Record the beginning of the phase. Returned value is an identifier which
+ * shall be passed to the alock_trace_end(). If tracing is not enabled, this
+ * function returns -1. It is safe to call this function from any thread. */
+int alock_trace_begin(const char *name, const char *category) {
+
+    unsigned int id;
+
+    if (trace.file == NULL)
+        return -1;
+    if ((id = __atomic_fetch_add(&trace.count, 1, __ATOMIC_RELAXED)) >= TRACE_EVENTS_MAX)
+        return -1;
+
+    trace.events[id].name = name;
+    trace.events[id].category = category;
+    trace.events[id].tid = trace_tid();
+    trace.events[id].dur = -1;
+    trace.events[id].arg = NULL;
+    trace.events[id].ts = trace_utime() - trace.origin;
+
+    return id;
+}
+
+/* Record the end of the phase started with alock_trace_begin(). */
+void alock_trace_end(int id) {
+    if (id == -1)
+        return;
+    trace.events[id].dur = trace_utime() - trace.origin - trace.events[id].ts;
+}
+
+/* Attach numerical argument (e.g. the number of processed bytes) to the
+ * event started with alock_trace_begin(). */
+void alock_trace_arg(int id, const char *name, long value) {
+    if (id == -1)
+        return;
+    trace.events[id].arg = name;
+    trace.events[id].value = value;
+}
+
+/* Record an instant event. */
+void alock_trace_mark(const char *name, const char *category) {
+    alock_trace_begin(name, category);
+}
+
+/* Write the given string as a JSON string literal. */
+static void trace_string(const char *str) {
+    fputc('"', trace.file);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(trace.file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(trace.file, "\\u%04x", *str);
+        else
+            fputc(*str, trace.file);
+    }
+    fputc('"', trace.file);
+}
+
+/* Write collected events and disable tracing. The output is a JSON object
+ * in the Trace Event Format, with time-stamps in microseconds relative to
+ * the alock_trace_open() call. Such a file can be loaded and visualized in
+ * e.g. the chrome://tracing tool. */
+void alock_trace_close(void) {
+
+    unsigned int i, count;
+    pid_t pid = getpid();
+
+    if (trace.file == NULL)
+        return;
+
+    if ((count = trace.count) > TRACE_EVENTS_MAX)
+        count = TRACE_EVENTS_MAX;
+
+    fprintf(trace.file, "{\"traceEvents\":[");
+    for (i = 0; i < count; i++) {
+        fprintf(trace.file, "%s\n{\"name\":", i == 0 ? "" : ",");
+        trace_string(trace.events[i].name);
+        fprintf(trace.file, ",\"cat\":");
+        trace_string(trace.events[i].category ? trace.events[i].category : "alock");
+        fprintf(trace.file, ",\"pid\":%d,\"tid\":%d,\"ts\":%lu,",
+                (int)pid, trace.events[i].tid, trace.events[i].ts);
+        if (trace.events[i].arg != NULL) {
+            fprintf(trace.file, "\"args\":{");
+            trace_string(trace.events[i].arg);
+            fprintf(trace.file, ":%ld},", trace.events[i].value);
+        }
+        if (trace.events[i].dur == -1)
+            fprintf(trace.file, "\"ph\":\"i\",\"s\":\"p\"}");
+        else
+            fprintf(trace.file, "\"ph\":\"X\",\"dur\":%ld}", trace.events[i].dur);
+    }
+    fprintf(trace.file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (trace.file != stderr)
+        fclose(trace.file);
+    trace.file = NULL;
+}
+
 /* Determine the Endianness of the system. */
 int alock_native_byte_order() {
     int x = 1;
@@ -63,6 +355,356 @@ int alock_alloc_color(Display *display,
     return 1;
 }
 
+#if HAVE_XEXT
+
+static int xshm_error = 0;
+static int xshm_error_handler(Display *display, XErrorEvent *event) {
+    (void)display;
+    (void)event;
+    xshm_error = 1;
+    return 0;
+}
+
+/* Check if the MIT-SHM extension can be used. Shared memory is usable only
+ * if the X server runs on the same host, so the attachment of the small test
+ * segment is verified. */
+static int check_xshm(Display *display) {
+
+    static int checked = 0;
+    static int available = 0;
+#if ENABLE_THREADS
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+#endif
+
+    if (!checked && XShmQueryExtension(display)) {
+
+        int (*handler)(Display *, XErrorEvent *);
+        XShmSegmentInfo info;
+
+        if ((info.shmid = shmget(IPC_PRIVATE, 1, IPC_CREAT | 0600)) != -1) {
+            if ((info.shmaddr = shmat(info.shmid, NULL, 0)) != (void *)-1) {
+                info.readOnly = False;
+                XSync(display, False);
+                xshm_error = 0;
+                handler = XSetErrorHandler(xshm_error_handler);
+                XShmAttach(display, &info);
+                XSync(display, False);
+                XSetErrorHandler(handler);
+                if ((available = !xshm_error)) {
+                    XShmDetach(display, &info);
+                    XSync(display, False);
+                }
+                shmdt(info.shmaddr);
+            }
+            shmctl(info.shmid, IPC_RMID, NULL);
+        }
+
+        debug("MIT-SHM available: %d", available);
+    }
+
+    checked = 1;
+
+#if ENABLE_THREADS
+    pthread_mutex_unlock(&mutex);
+#endif
+    return available;
+}
+
+struct xshm_completion {
+    int type;
+    ShmSeg shmseg;
+};
+
+static Bool xshm_completion_predicate(Display *display, XEvent *event, XPointer arg) {
+    (void)display;
+    struct xshm_completion *c = (struct xshm_completion *)arg;
+    return event->type == c->type && ((XShmCompletionEvent *)event)->shmseg == c->shmseg;
+}
+
+#endif /* HAVE_XEXT */
+
+/* Check whether images created with the alock_create_image() are going to be
+ * placed in the memory shared with the X server. */
+int alock_check_xshm(Display *display) {
+#if HAVE_XEXT
+    return check_xshm(display);
+#else
+    (void)display;
+    return 0;
+#endif
+}
+
+/* Create the ZPixmap image of the given size. If possible, the image data is
+ * placed in the memory shared with the X server, so pixels do not have to be
+ * sent through the connection socket. The image should be transferred with
+ * the alock_capture_image() and alock_upload_image(), and it has to be
+ * destroyed with the alock_destroy_image(). */
+XImage *alock_create_image(Display *display,
+        Visual *visual,
+        int depth,
+        unsigned int width,
+        unsigned int height) {
+
+    XImage *image;
+
+#if HAVE_XEXT
+    if (check_xshm(display)) {
+
+        XShmSegmentInfo *info;
+
+        if ((info = malloc(sizeof(*info))) == NULL)
+            goto fallback;
+        if ((image = XShmCreateImage(display, visual, depth, ZPixmap, NULL,
+                        info, width, height)) == NULL)
+            goto fail_image;
+        if ((info->shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * height,
+                        IPC_CREAT | 0600)) == -1)
+            goto fail_shmget;
+        if ((info->shmaddr = image->data = shmat(info->shmid, NULL, 0)) == (void *)-1)
+            goto fail_shmat;
+
+        info->readOnly = False;
+        if (!XShmAttach(display, info))
+            goto fail_attach;
+
+        /* the segment is released as soon as both sides detach it */
+        XSync(display, False);
+        shmctl(info->shmid, IPC_RMID, NULL);
+
+        return image;
+
+fail_attach:
+        shmdt(info->shmaddr);
+fail_shmat:
+        shmctl(info->shmid, IPC_RMID, NULL);
+fail_shmget:
+        image->data = NULL;
+        XDestroyImage(image);
+fail_image:
+        free(info);
+    }
+fallback:
+#endif
+
+    if ((image = XCreateImage(display, visual, depth, ZPixmap, 0, NULL,
+                    width, height, 32, 0)) == NULL)
+        return NULL;
+    if ((image->data = malloc((size_t)image->bytes_per_line * height)) == NULL) {
+        XDestroyImage(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+/* Destroy image created with the alock_create_image(). */
+void alock_destroy_image(Display *display, XImage *image) {
+
+#if HAVE_XEXT
+    /* NOTE: Regular images do not use the object data. */
+    if (image->obdata != NULL) {
+        XShmSegmentInfo *info = (XShmSegmentInfo *)image->obdata;
+        XShmDetach(display, info);
+        shmdt(info->shmaddr);
+        image->data = NULL;
+        XDestroyImage(image);
+        free(info);
+        return;
+    }
+#else
+    (void)display;
+#endif
+
+    XDestroyImage(image);
+}
+
+/* Get the content of the drawable, starting at the given position, into the
+ * first rows of the image (the width of the image is used). It allows to
+ * reuse one image as a buffer for strips of different height. On success
+ * this function returns 0, otherwise -1. */
+int alock_capture_image(Display *display,
+        Drawable drawable,
+        XImage *image,
+        int x, int y,
+        unsigned int height) {
+
+#if HAVE_XEXT
+    if (image->obdata != NULL) {
+        /* NOTE: The size of the MIT-SHM request is taken from the image. */
+        int rows = image->height;
+        Bool rv;
+        image->height = height;
+        rv = XShmGetImage(display, drawable, image, x, y, AllPlanes);
+        image->height = rows;
+        return rv ? 0 : -1;
+    }
+#endif
+
+    return XGetSubImage(display, drawable, x, y, image->width, height,
+            AllPlanes, ZPixmap, image, 0, 0) != NULL ? 0 : -1;
+}
+
+/* Request the content of the drawable for the given rows of the image. When
+ * Xlib uses the XCB transport, the request is sent right away without
+ * waiting for the reply, so the transfer overlaps with the processing of the
+ * previously fetched rows. Images in the shared memory (or when XCB is not
+ * available) are captured synchronously by the alock_capture_fetch(). On
+ * success this function returns 0, otherwise -1 (the queue is full). */
+int alock_capture_request(Display *display,
+        struct aCaptureQueue *queue,
+        Drawable drawable,
+        XImage *image,
+        int x, int y,
+        unsigned int height) {
+
+    const unsigned int size = sizeof(queue->requests) / sizeof(*queue->requests);
+    unsigned int i;
+
+    if (queue->count == size)
+        return -1;
+
+    i = (queue->head + queue->count) % size;
+    queue->requests[i].drawable = drawable;
+    queue->requests[i].x = x;
+    queue->requests[i].y = y;
+    queue->requests[i].height = height;
+    queue->requests[i].sequence = 0;
+    queue->count++;
+
+#if HAVE_X11_XCB
+    if (image->obdata == NULL) {
+        xcb_get_image_cookie_t cookie;
+        cookie = xcb_get_image(XGetXCBConnection(display), XCB_IMAGE_FORMAT_Z_PIXMAP,
+                drawable, x, y, image->width, height, ~0);
+        queue->requests[i].sequence = cookie.sequence;
+    }
+#else
+    (void)display;
+    (void)image;
+#endif
+
+    return 0;
+}
+
+/* Get the content requested with the oldest alock_capture_request() call into
+ * the first rows of the image. On success this function returns 0, otherwise
+ * -1 (e.g. the queue is empty). */
+int alock_capture_fetch(Display *display,
+        struct aCaptureQueue *queue,
+        XImage *image) {
+
+    const unsigned int size = sizeof(queue->requests) / sizeof(*queue->requests);
+    unsigned int i;
+
+    if (queue->count == 0)
+        return -1;
+
+    i = queue->head;
+    queue->head = (queue->head + 1) % size;
+    queue->count--;
+
+#if HAVE_X11_XCB
+    if (queue->requests[i].sequence != 0) {
+
+        xcb_get_image_cookie_t cookie = { queue->requests[i].sequence };
+        xcb_get_image_reply_t *reply;
+        const uint8_t *src;
+        size_t stride, length;
+        unsigned int row;
+        int trace;
+
+        trace = alock_trace_begin("capture.xcb", NULL);
+        reply = xcb_get_image_reply(XGetXCBConnection(display), cookie, NULL);
+        alock_trace_end(trace);
+
+        if (reply == NULL)
+            return -1;
+
+        /* NOTE: Rows in the reply are padded according to the server pixmap
+         *       format, which might be different than the padding used by
+         *       the client-side image. */
+        src = xcb_get_image_data(reply);
+        length = xcb_get_image_data_length(reply);
+        stride = length / queue->requests[i].height;
+        for (row = 0; row < queue->requests[i].height; row++)
+            memcpy(image->data + (size_t)row * image->bytes_per_line,
+                    src + row * stride,
+                    stride < (size_t)image->bytes_per_line ? stride : (size_t)image->bytes_per_line);
+
+        free(reply);
+        return 0;
+    }
+#endif
+
+    return alock_capture_image(display, queue->requests[i].drawable, image,
+            queue->requests[i].x, queue->requests[i].y, queue->requests[i].height);
+}
+
+/* Put the given part of the image into the drawable. Images in the shared
+ * memory are transferred with the MIT-SHM extension, and this function waits
+ * for the completion, so afterwards the image can be modified or destroyed.
+ * Other images are sent in chunks of rows, where every chunk fits into the
+ * single request. The number of bytes is recorded for the given module in
+ * the phase-timing trace. */
+void alock_upload_image(Display *display,
+        Drawable drawable,
+        GC gc,
+        XImage *image,
+        int src_x, int src_y,
+        int dst_x, int dst_y,
+        unsigned int width,
+        unsigned int height,
+        const char *module) {
+
+    size_t bytes = (size_t)(width * image->bits_per_pixel + 7) / 8 * height;
+    unsigned int y, rows;
+    long max;
+    int trace;
+
+#if HAVE_XEXT
+    if (image->obdata != NULL) {
+
+        struct xshm_completion c = {
+            XShmGetEventBase(display) + ShmCompletion,
+            ((XShmSegmentInfo *)image->obdata)->shmseg,
+        };
+        XEvent event;
+
+        trace = alock_trace_begin("upload.shm", module);
+        XShmPutImage(display, drawable, gc, image, src_x, src_y, dst_x, dst_y,
+                width, height, True);
+        XIfEvent(display, &event, xshm_completion_predicate, (XPointer)&c);
+        alock_trace_arg(trace, "bytes", bytes);
+        alock_trace_end(trace);
+
+        debug("upload [%s]: %zu bytes via MIT-SHM", module, bytes);
+        return;
+    }
+#endif
+
+    /* maximal request size in bytes, reduced by the PutImage header */
+    if ((max = XExtendedMaxRequestSize(display)) == 0)
+        max = XMaxRequestSize(display);
+    max = max * 4 - 64;
+
+    if ((rows = max / image->bytes_per_line) == 0)
+        rows = 1;
+
+    trace = alock_trace_begin("upload.put", module);
+    for (y = 0; y < height; y += rows)
+        XPutImage(display, drawable, gc, image, src_x, src_y + y, dst_x, dst_y + y,
+                width, y + rows > height ? height - y : rows);
+    alock_trace_arg(trace, "bytes", bytes);
+    alock_trace_end(trace);
+
+    debug("upload [%s]: %zu bytes in %u requests", module, bytes, (height + rows - 1) / rows);
+}
+
+#endif /* !ALOCK_PLUGIN */
+
+#if !ALOCK_PLUGIN_HOST
+
 /* Check if the X server supports RENDER extension. */
 int alock_check_xrender(Display *display) {
 #if ENABLE_XRENDER
@@ -85,6 +727,70 @@ int alock_check_xrender(Display *display) {
 #endif /* ENABLE_XRENDER */
 }
 
+/* Check if the X server supports PDF blend modes (RENDER 0.11 and later),
+ * which are used by the alock_grayscale_pixmap(). */
+int alock_check_xrender_blend(Display *display) {
+#if ENABLE_XRENDER && defined(PictOpHSLSaturation)
+    static int checked = 0;
+    static int available = 0;
+
+    if (checked)
+        return available;
+
+    int major, minor;
+    checked = 1;
+
+    if (alock_check_xrender(display) &&
+            XRenderQueryVersion(display, &major, &minor))
+        available = major > 0 || minor >= 11;
+
+    debug("XRender blend modes: %s", available ? "available" : "missing");
+    return available;
+#else
+    (void)display;
+    return 0;
+#endif /* ENABLE_XRENDER */
+}
+
+/* Convert given pixmap to the grayscale in-place. The saturation of every
+ * pixel is replaced with the saturation of the solid gray (zero) using the
+ * HSL blend mode, so the pixels do not have to leave the X server. This
+ * function returns 0 if the server does not support blend modes. */
+int alock_grayscale_pixmap(Display *display,
+        Visual *visual,
+        Pixmap pixmap,
+        unsigned int width,
+        unsigned int height) {
+#if ENABLE_XRENDER && defined(PictOpHSLSaturation)
+
+    const XRenderColor gray = { 0x8000, 0x8000, 0x8000, 0xffff };
+    XRenderPictFormat *format;
+    Picture pic, gray_pic;
+
+    if (!alock_check_xrender_blend(display))
+        return 0;
+
+    format = XRenderFindVisualFormat(display, visual);
+    pic = XRenderCreatePicture(display, pixmap, format, 0, NULL);
+    gray_pic = XRenderCreateSolidFill(display, &gray);
+
+    XRenderComposite(display, PictOpHSLSaturation, gray_pic, None, pic,
+            0, 0, 0, 0, 0, 0, width, height);
+
+    XRenderFreePicture(display, gray_pic);
+    XRenderFreePicture(display, pic);
+    return 1;
+
+#else
+    (void)display;
+    (void)visual;
+    (void)pixmap;
+    (void)width;
+    (void)height;
+    return 0;
+#endif /* ENABLE_XRENDER */
+}
+
 /* Shade given source pixmap by the amount specified by the shade parameter,
  * which should be in range [0, 100]. */
 int alock_shade_pixmap(Display *display,
@@ -181,6 +887,12 @@ int alock_blur_pixmap(Display *display,
 
 #if ENABLE_IMLIB2
 
+#if ENABLE_THREADS
+    /* Imlib2 context stack is global, hence not thread-safe. */
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+#endif
+
     Imlib_Context ctx = imlib_context_new();
 
     imlib_context_push(ctx);
@@ -198,6 +910,10 @@ int alock_blur_pixmap(Display *display,
 
     imlib_context_pop();
     imlib_context_free(ctx);
+
+#if ENABLE_THREADS
+    pthread_mutex_unlock(&mutex);
+#endif
     return 1;
 
 #elif ENABLE_XRENDER
@@ -260,32 +976,192 @@ int alock_blur_pixmap(Display *display,
 #endif
 }
 
+/* Pixelate given pixmap in-place with square blocks of the given size. The
+ * content is downscaled and then upscaled back with the nearest-neighbour
+ * filter, so the whole operation is performed by the X server and its cost
+ * does not depend on the block size. */
+int alock_pixelate_pixmap(Display *display,
+        Visual *visual,
+        Pixmap pixmap,
+        unsigned int size,
+        unsigned int width,
+        unsigned int height) {
+
+    if (size < 2)
+        return 1;
+
+#if ENABLE_XRENDER
+
+    const unsigned int w = (width + size - 1) / size;
+    const unsigned int h = (height + size - 1) / size;
+    XRenderPictFormat *format = XRenderFindVisualFormat(display, visual);
+    XTransform transform = { {
+        { XDoubleToFixed(size), 0, 0 },
+        { 0, XDoubleToFixed(size), 0 },
+        { 0, 0, XDoubleToFixed(1) },
+    } };
+    Picture pic, small_pic;
+    Pixmap small_pm;
+
+    small_pm = XCreatePixmap(display, pixmap, w, h, format->depth);
+    pic = XRenderCreatePicture(display, pixmap, format, 0, NULL);
+    small_pic = XRenderCreatePicture(display, small_pm, format, 0, NULL);
+
+    /* One sample per block. It is taken from the first pixel of the block
+     * instead of its center, because partial blocks on the right and bottom
+     * edges might not reach the center - such a sample would lie outside of
+     * the given area (or even outside of the pixmap). */
+    transform.matrix[0][2] = transform.matrix[1][2] = XDoubleToFixed(0.5 - size / 2.0);
+    XRenderSetPictureFilter(display, pic, FilterNearest, NULL, 0);
+    XRenderSetPictureTransform(display, pic, &transform);
+    XRenderComposite(display, PictOpSrc, pic, None, small_pic,
+            0, 0, 0, 0, 0, 0, w, h);
+
+    /* and back to the original size */
+    transform.matrix[0][0] = transform.matrix[1][1] = XDoubleToFixed(1.0 / size);
+    transform.matrix[0][2] = transform.matrix[1][2] = 0;
+    XRenderSetPictureFilter(display, small_pic, FilterNearest, NULL, 0);
+    XRenderSetPictureTransform(display, small_pic, &transform);
+    XRenderComposite(display, PictOpSrc, small_pic, None, pic,
+            0, 0, 0, 0, 0, 0, width, height);
+
+    XRenderFreePicture(display, small_pic);
+    XRenderFreePicture(display, pic);
+    XFreePixmap(display, small_pm);
+
+    return 1;
+
+#else
+    (void)display;
+    (void)visual;
+    (void)pixmap;
+    (void)width;
+    (void)height;
+    return 0;
+#endif /* ENABLE_XRENDER */
+}
+
+/* Pixel layout of the image, which is resolved once per conversion from
+ * the color masks of the image. */
+struct grayFormat {
+    unsigned int shift[3];
+    unsigned int bits[3];
+    /* image byte order differs from the host one */
+    int swap;
+};
+
+/* Integer luminance weights (sum is 256) for the colorimetric conversion. */
+#define GRAY_LUMA(r, g, b) (((r) * 54 + (g) * 183 + (b) * 19) >> 8)
+
+static int gray_mask(unsigned long mask, unsigned int *shift, unsigned int *bits) {
+    if (mask == 0)
+        return -1;
+    for (*shift = 0; !(mask & 1); mask >>= 1)
+        (*shift)++;
+    for (*bits = 0; mask & 1; mask >>= 1)
+        (*bits)++;
+    /* channel mask has to be contiguous */
+    return mask == 0 && *bits <= 16 ? 0 : -1;
+}
+
+/* NOTE: Kernels below are always inlined with the constant channel width and
+ *       byte order, so the compiler emits a specialized loop for every pixel
+ *       format and there are no format checks per pixel. */
+
+static inline __attribute__ ((always_inline))
+void gray_row32(uint32_t *p, unsigned int n, const struct grayFormat *f,
+        const unsigned int bits, const int swap) {
+
+    const uint32_t max = (1 << bits) - 1;
+    const uint32_t keep = ~((max << f->shift[0]) | (max << f->shift[1]) |
+            (max << f->shift[2]));
+    uint32_t v, y;
+
+    while (n--) {
+        v = swap ? __builtin_bswap32(*p) : *p;
+        y = GRAY_LUMA((v >> f->shift[0]) & max, (v >> f->shift[1]) & max,
+                (v >> f->shift[2]) & max);
+        /* bits outside of the color masks (e.g. alpha) are preserved */
+        v = (v & keep) | (y << f->shift[0]) | (y << f->shift[1]) | (y << f->shift[2]);
+        *p++ = swap ? __builtin_bswap32(v) : v;
+    }
+
+}
+
+static inline __attribute__ ((always_inline))
+void gray_row16(uint16_t *p, unsigned int n, const struct grayFormat *f,
+        const int swap) {
+
+    const unsigned int r8 = 8 - f->bits[0];
+    const unsigned int g8 = 8 - f->bits[1];
+    const unsigned int b8 = 8 - f->bits[2];
+    const uint16_t rmax = (1 << f->bits[0]) - 1;
+    const uint16_t gmax = (1 << f->bits[1]) - 1;
+    const uint16_t bmax = (1 << f->bits[2]) - 1;
+    const uint16_t keep = ~((rmax << f->shift[0]) | (gmax << f->shift[1]) |
+            (bmax << f->shift[2]));
+    uint16_t v, y;
+
+    while (n--) {
+        v = swap ? __builtin_bswap16(*p) : *p;
+        /* every channel is expanded to 8 bits, e.g. 6-bit green of RGB565
+         * has the better precision than the red and blue channels */
+        y = GRAY_LUMA(((v >> f->shift[0]) & rmax) << r8,
+                ((v >> f->shift[1]) & gmax) << g8,
+                ((v >> f->shift[2]) & bmax) << b8);
+        v = (v & keep) | ((y >> r8) << f->shift[0]) | ((y >> g8) << f->shift[1]) |
+            ((y >> b8) << f->shift[2]);
+        *p++ = swap ? __builtin_bswap16(v) : v;
+    }
+
+}
+
+static void gray_row32_8(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row32(p, n, f, 8, 0);
+}
+
+static void gray_row32_8_swap(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row32(p, n, f, 8, 1);
+}
+
+static void gray_row32_10(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row32(p, n, f, 10, 0);
+}
+
+static void gray_row32_10_swap(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row32(p, n, f, 10, 1);
+}
+
+static void gray_row16_any(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row16(p, n, f, 0);
+}
+
+static void gray_row16_swap(void *p, unsigned int n, const struct grayFormat *f) {
+    gray_row16(p, n, f, 1);
+}
+
 /* Convert given color image to the grayscale intensity one. Note, that this
- * function performs in-place conversion. */
+ * function performs in-place conversion.
+ *
+ * The conversion kernel is selected once for the given image, based on its
+ * color masks and byte order. Specialized kernels handle 16-bit (e.g. RGB565)
+ * images, and 32-bit images with 8-bit (24-bit and ARGB visuals) or 10-bit
+ * (30-bit deep color visuals) channels in any channel order. Other TrueColor
+ * layouts are converted pixel by pixel with the XGetPixel(). */
 int alock_grayscale_image(XImage *image,
         int x, int y,
         unsigned int width,
         unsigned int height) {
 
-    union {
-        struct __attribute__ ((packed)) {
-            uint16_t red   : 5;
-            uint16_t green : 6;
-            uint16_t blue  : 5;
-        } v16;
-        struct __attribute__ ((packed)) {
-            uint8_t red;
-            uint8_t green;
-            uint8_t blue;
-        } v24;
-        unsigned long value;
-    } pixel;
-
-    int depth = image->depth;
-    int _x, _y;
-
-    if (depth != 16 && depth != 24) {
-        fprintf(stderr, "alock: screen depth %d is not supported\n", depth);
+    void (*kernel)(void *, unsigned int, const struct grayFormat *) = NULL;
+    struct grayFormat f;
+    unsigned int _x, _y;
+
+    if (image->format != ZPixmap ||
+            gray_mask(image->red_mask, &f.shift[0], &f.bits[0]) == -1 ||
+            gray_mask(image->green_mask, &f.shift[1], &f.bits[1]) == -1 ||
+            gray_mask(image->blue_mask, &f.shift[2], &f.bits[2]) == -1) {
+        fprintf(stderr, "alock: screen depth %d is not supported\n", image->depth);
         return 0;
     }
 
@@ -293,29 +1169,158 @@ int alock_grayscale_image(XImage *image,
      *       principle is, that the luminance of the grayscale image should
      *       match the luminance of the original color image. */
 
-    for (_x = x; _x < (signed)width; _x++)
-        for (_y = y; _y < (signed)height; _y++) {
-            pixel.value = XGetPixel(image, _x, _y);
-
-            if (depth == 24)
-                pixel.v24.red = pixel.v24.green = pixel.v24.blue =
-                        0.2126 * pixel.v24.red +
-                        0.7152 * pixel.v24.green +
-                        0.0722 * pixel.v24.blue;
-            else {
-                pixel.v16.green =
-                        0.2126 * (pixel.v16.red << 1) +
-                        0.7152 * pixel.v16.green +
-                        0.0722 * (pixel.v16.blue << 1);
-                pixel.v16.red = pixel.v16.blue = pixel.v16.green >> 1;
+    f.swap = image->byte_order != alock_native_byte_order();
+
+    if (image->bits_per_pixel == 32 &&
+            f.bits[0] == f.bits[1] && f.bits[1] == f.bits[2]) {
+        if (f.bits[0] == 8)
+            kernel = f.swap ? gray_row32_8_swap : gray_row32_8;
+        else if (f.bits[0] == 10)
+            kernel = f.swap ? gray_row32_10_swap : gray_row32_10;
+    }
+    else if (image->bits_per_pixel == 16 &&
+            f.bits[0] <= 8 && f.bits[1] <= 8 && f.bits[2] <= 8)
+        kernel = f.swap ? gray_row16_swap : gray_row16_any;
+
+    if (kernel != NULL) {
+        char *row = image->data + (size_t)y * image->bytes_per_line +
+            (size_t)x * image->bits_per_pixel / 8;
+        for (_y = 0; _y < height; _y++, row += image->bytes_per_line)
+            kernel(row, width, &f);
+        return 1;
+    }
+
+    debug("grayscale: generic conversion of %d bpp image", image->bits_per_pixel);
+
+    for (_y = y; _y < y + height; _y++)
+        for (_x = x; _x < x + width; _x++) {
+
+            unsigned long v = XGetPixel(image, _x, _y);
+            unsigned long c[3], l;
+            int i;
+
+            for (i = 0; i < 3; i++) {
+                c[i] = (v >> f.shift[i]) & ((1UL << f.bits[i]) - 1);
+                /* scale channel to the 16-bit range */
+                c[i] = c[i] * 0xffff / ((1UL << f.bits[i]) - 1);
             }
 
-            XPutPixel(image, _x, _y, pixel.value);
+            l = GRAY_LUMA(c[0], c[1], c[2]);
+            v &= ~(image->red_mask | image->green_mask | image->blue_mask);
+            for (i = 0; i < 3; i++)
+                v |= (l * ((1UL << f.bits[i]) - 1) / 0xffff) << f.shift[i];
+
+            XPutPixel(image, _x, _y, v);
         }
 
     return 1;
 }
 
+/* Lookup tables for the fused grayscale, tint and shade conversion. */
+struct shadeLUT {
+    XImage *image;
+    int x, y;
+    unsigned int width, height;
+    unsigned int keep;
+    /* channel contributions to the luminance in the 16.16 fixed point */
+    uint32_t luma[3][256];
+    /* blended output of every channel, already shifted into place */
+    uint32_t out[3][256];
+    unsigned int shift[3];
+    int swap;
+};
+
+#define SHADE_BAND_ROWS 64
+
+static int shade_band(unsigned int index, void *arg) {
+
+    const struct shadeLUT *lut = (const struct shadeLUT *)arg;
+    unsigned int y0 = index * SHADE_BAND_ROWS;
+    unsigned int y1 = y0 + SHADE_BAND_ROWS;
+    unsigned int _x, _y;
+    uint32_t *p, v, l;
+
+    if (y1 > lut->height)
+        y1 = lut->height;
+
+    for (_y = y0; _y < y1; _y++) {
+        p = (uint32_t *)(lut->image->data +
+                (size_t)(lut->y + _y) * lut->image->bytes_per_line) + lut->x;
+        for (_x = 0; _x < lut->width; _x++) {
+            v = lut->swap ? __builtin_bswap32(p[_x]) : p[_x];
+            l = (lut->luma[0][(v >> lut->shift[0]) & 0xff] +
+                    lut->luma[1][(v >> lut->shift[1]) & 0xff] +
+                    lut->luma[2][(v >> lut->shift[2]) & 0xff]) >> 16;
+            v = (v & lut->keep) | lut->out[0][l] | lut->out[1][l] | lut->out[2][l];
+            p[_x] = lut->swap ? __builtin_bswap32(v) : v;
+        }
+    }
+
+    return 0;
+}
+
+/* Convert given color image to the grayscale one, and blend it with the tint
+ * color in the same way as alock_shade_pixmap() does. It is equivalent to the
+ * alock_grayscale_image() followed by the shading, but it is performed in a
+ * single pass with precomputed per-channel lookup tables, and image rows are
+ * processed in parallel. Only 32-bit images with 8-bit channels are supported,
+ * in other case this function returns 0 and the image is not modified. */
+int alock_grayscale_shade_image(XImage *image,
+        int x, int y,
+        unsigned int width,
+        unsigned int height,
+        const XColor *tint,
+        unsigned char shade) {
+
+    /* luminance weights, which sum up to 1.0 in the 16.16 fixed point */
+    const uint32_t weights[3] = { 13933, 46871, 4732 };
+    const unsigned short colors[3] = { tint->red, tint->green, tint->blue };
+    const unsigned long masks[3] = {
+        image->red_mask, image->green_mask, image->blue_mask };
+    struct shadeLUT *lut;
+    unsigned int i, c, bits, alpha;
+
+    if (image->format != ZPixmap || image->bits_per_pixel != 32)
+        return 0;
+
+    if ((lut = malloc(sizeof(*lut))) == NULL)
+        return 0;
+
+    if (shade > 100)
+        shade = 100;
+    alpha = 255 * shade / 100;
+
+    lut->keep = 0xffffffff;
+    for (c = 0; c < 3; c++) {
+        if (gray_mask(masks[c], &lut->shift[c], &bits) == -1 || bits != 8) {
+            free(lut);
+            return 0;
+        }
+        lut->keep &= ~masks[c];
+        for (i = 0; i < 256; i++) {
+            lut->luma[c][i] = weights[c] * i;
+            lut->out[c][i] = ((i * alpha + (colors[c] >> 8) * (255 - alpha) + 127) / 255)
+                << lut->shift[c];
+        }
+    }
+
+    lut->image = image;
+    lut->x = x;
+    lut->y = y;
+    lut->width = width;
+    lut->height = height;
+    lut->swap = image->byte_order != alock_native_byte_order();
+
+    alock_parallel((height + SHADE_BAND_ROWS - 1) / SHADE_BAND_ROWS, shade_band, lut);
+
+    free(lut);
+    return 1;
+}
+
+#endif /* !ALOCK_PLUGIN_HOST */
+
+#if !ALOCK_PLUGIN
+
 /* Dummy function for module interface. */
 void module_dummy_loadargs(const char *args) {
     (void)args;
@@ -339,3 +1344,5 @@ int module_dummy_init(Display *display) {
 void module_dummy_free(void) {
     debug("dummy free");
 }
+
+#endif /* !ALOCK_PLUGIN */